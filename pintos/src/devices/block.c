@@ -4,6 +4,9 @@
 #include <stdio.h>
 #include "devices/ide.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/trace.h"
 
 /* A block device. */
 struct block {
@@ -18,6 +21,12 @@ struct block {
 
   unsigned long long read_cnt;  /* Number of sectors read. */
   unsigned long long write_cnt; /* Number of sectors written. */
+
+  /* Request queue, served by the dispatcher thread. */
+  struct list queue;               /* Pending requests, by sector. */
+  struct lock queue_lock;          /* Protects the queue fields. */
+  struct condition queue_nonempty; /* Signaled when a request is queued. */
+  block_sector_t head;             /* Sector after the last one transferred. */
 };
 
 /* List of all block devices. */
@@ -90,14 +99,144 @@ static void check_sector(struct block* block, block_sector_t sector) {
   }
 }
 
+static bool request_less(const struct list_elem* a_, const struct list_elem* b_,
+                         void* aux UNUSED) {
+  const struct block_request* a = list_entry(a_, struct block_request, elem);
+  const struct block_request* b = list_entry(b_, struct block_request, elem);
+  return a->sector < b->sector;
+}
+
+/* Moves the next batch of requests for BLOCK from its queue to
+   BATCH: the first request at or past the head in sector order,
+   wrapping around to the lowest sector (C-LOOK), followed by
+   requests for the consecutive sectors in the same direction.
+   BLOCK's queue lock must be held and its queue nonempty. */
+static void next_batch(struct block* block, struct list* batch) {
+  struct list_elem* e;
+  struct block_request* r;
+  size_t cnt = 0;
+
+  for (e = list_begin(&block->queue); e != list_end(&block->queue); e = list_next(e))
+    if (list_entry(e, struct block_request, elem)->sector >= block->head)
+      break;
+  if (e == list_end(&block->queue))
+    e = list_begin(&block->queue);
+
+  list_init(batch);
+  do {
+    r = list_entry(e, struct block_request, elem);
+    e = list_remove(e);
+    list_push_back(batch, &r->elem);
+    cnt++;
+  } while (e != list_end(&block->queue) && cnt < BLOCK_BATCH_MAX &&
+           list_entry(e, struct block_request, elem)->sector == r->sector + 1 &&
+           list_entry(e, struct block_request, elem)->write == r->write);
+  block->head = r->sector + 1;
+}
+
+/* Performs the transfers for BATCH, a list of requests for
+   consecutive sectors in the same direction, on BLOCK.  Uses the
+   driver's multi-sector operation if it has one, so that the whole
+   batch goes to the device as a single command. */
+static void serve_batch(struct block* block, struct list* batch) {
+  struct block_request* first = list_entry(list_front(batch), struct block_request, elem);
+  void* buffers[BLOCK_BATCH_MAX];
+  struct list_elem* e;
+  size_t cnt = 0;
+
+  for (e = list_begin(batch); e != list_end(batch); e = list_next(e))
+    buffers[cnt++] = list_entry(e, struct block_request, elem)->buffer;
+
+  if (first->write) {
+    if (block->ops->write_multiple != NULL)
+      block->ops->write_multiple(block->aux, first->sector, buffers, cnt);
+    else
+      for (size_t i = 0; i < cnt; i++)
+        block->ops->write(block->aux, first->sector + i, buffers[i]);
+    block->write_cnt += cnt;
+  } else {
+    if (block->ops->read_multiple != NULL)
+      block->ops->read_multiple(block->aux, first->sector, buffers, cnt);
+    else
+      for (size_t i = 0; i < cnt; i++)
+        block->ops->read(block->aux, first->sector + i, buffers[i]);
+    block->read_cnt += cnt;
+  }
+}
+
+/* Dispatcher thread for block device BLOCK_.  Serves one batch at
+   a time, with the queue unlocked so that more requests can be
+   submitted meanwhile, then runs the batch's callbacks. */
+static void dispatcher(void* block_) {
+  struct block* block = block_;
+  struct list batch;
+
+  for (;;) {
+    lock_acquire(&block->queue_lock);
+    while (list_empty(&block->queue))
+      cond_wait(&block->queue_nonempty, &block->queue_lock);
+    next_batch(block, &batch);
+    lock_release(&block->queue_lock);
+
+    serve_batch(block, &batch);
+    while (!list_empty(&batch)) {
+      struct block_request* r = list_entry(list_pop_front(&batch), struct block_request, elem);
+      r->done(r);
+    }
+  }
+}
+
+/* Queues request R on BLOCK and returns without waiting for it.
+   R must stay valid until its callback has run.  If BLOCK's driver
+   has a submit operation, R goes straight to it instead, and is
+   counted here since BLOCK's dispatcher never sees it. */
+void block_submit(struct block* block, struct block_request* r) {
+  check_sector(block, r->sector);
+  ASSERT(!r->write || block->type != BLOCK_FOREIGN);
+  ASSERT(r->done != NULL);
+
+  if (block->ops->submit != NULL) {
+    if (r->write)
+      block->write_cnt++;
+    else
+      block->read_cnt++;
+    block->ops->submit(block->aux, r);
+    return;
+  }
+
+  lock_acquire(&block->queue_lock);
+  list_insert_ordered(&block->queue, &r->elem, request_less, NULL);
+  cond_signal(&block->queue_nonempty, &block->queue_lock);
+  lock_release(&block->queue_lock);
+}
+
+/* Completion callback for block_read() and block_write(): wakes
+   the thread waiting on the semaphore in R's aux. */
+static void wake_waiter(struct block_request* r) { sema_up(r->aux); }
+
+/* Submits a request for SECTOR on BLOCK and waits for it. */
+static void transfer(struct block* block, block_sector_t sector, void* buffer, bool write) {
+  struct block_request r;
+  struct semaphore done;
+
+  sema_init(&done, 0);
+  r.sector = sector;
+  r.buffer = buffer;
+  r.write = write;
+  r.done = wake_waiter;
+  r.aux = &done;
+  TRACE(TRACE_IO_START, sector, 1, write);
+  block_submit(block, &r);
+  sema_down(&done);
+  TRACE(TRACE_IO_DONE, sector, 1, write);
+}
+
 /* Reads sector SECTOR from BLOCK into BUFFER, which must
    have room for BLOCK_SECTOR_SIZE bytes.
    Internally synchronizes accesses to block devices, so external
    per-block device locking is unneeded. */
 void block_read(struct block* block, block_sector_t sector, void* buffer) {
-  check_sector(block, sector);
-  block->ops->read(block->aux, sector, buffer);
-  block->read_cnt++;
+  transfer(block, sector, buffer, false);
 }
 
 /* Write sector SECTOR to BLOCK from BUFFER, which must contain
@@ -106,10 +245,55 @@ void block_read(struct block* block, block_sector_t sector, void* buffer) {
    Internally synchronizes accesses to block devices, so external
    per-block device locking is unneeded. */
 void block_write(struct block* block, block_sector_t sector, const void* buffer) {
-  check_sector(block, sector);
-  ASSERT(block->type != BLOCK_FOREIGN);
-  block->ops->write(block->aux, sector, buffer);
-  block->write_cnt++;
+  transfer(block, sector, (void*)buffer, true);
+}
+
+/* Submits requests for the CNT sectors starting at SECTOR on
+   BLOCK, to or from BUFFERS, all at once so that the dispatcher
+   can serve them as one batch, and waits for all of them. */
+static void transfer_multiple(struct block* block, block_sector_t sector, void* const buffers[],
+                              size_t cnt, bool write) {
+  struct block_request* reqs;
+  struct semaphore done;
+
+  reqs = malloc(cnt * sizeof *reqs);
+  if (reqs == NULL) {
+    for (size_t i = 0; i < cnt; i++)
+      transfer(block, sector + i, buffers[i], write);
+    return;
+  }
+
+  sema_init(&done, 0);
+  TRACE(TRACE_IO_START, sector, cnt, write);
+  for (size_t i = 0; i < cnt; i++) {
+    reqs[i].sector = sector + i;
+    reqs[i].buffer = buffers[i];
+    reqs[i].write = write;
+    reqs[i].done = wake_waiter;
+    reqs[i].aux = &done;
+    block_submit(block, &reqs[i]);
+  }
+  for (size_t i = 0; i < cnt; i++)
+    sema_down(&done);
+  TRACE(TRACE_IO_DONE, sector, cnt, write);
+  free(reqs);
+}
+
+/* Reads the CNT sectors starting at SECTOR from BLOCK into
+   BUFFERS[0] through BUFFERS[CNT - 1], each of which must have
+   room for BLOCK_SECTOR_SIZE bytes.  The device sees as few
+   commands as it can serve the sectors with. */
+void block_read_multiple(struct block* block, block_sector_t sector, void* buffers[],
+                         size_t cnt) {
+  transfer_multiple(block, sector, buffers, cnt, false);
+}
+
+/* Writes the CNT sectors starting at SECTOR to BLOCK from
+   BUFFERS[0] through BUFFERS[CNT - 1], as block_read_multiple().
+   Returns after the device has acknowledged all of them. */
+void block_write_multiple(struct block* block, block_sector_t sector, void* const buffers[],
+                          size_t cnt) {
+  transfer_multiple(block, sector, buffers, cnt, true);
 }
 
 /* Returns the number of sectors in BLOCK. */
@@ -153,6 +337,17 @@ struct block* block_register(const char* name, enum block_type type, const char*
   block->aux = aux;
   block->read_cnt = 0;
   block->write_cnt = 0;
+  list_init(&block->queue);
+  lock_init(&block->queue_lock);
+  lock_set_name(&block->queue_lock, block->name);
+  cond_init(&block->queue_nonempty);
+  block->head = 0;
+
+  /* A driver without a submit operation has its requests served
+     by a dispatcher thread of its own. */
+  if (ops->submit == NULL &&
+      thread_create(block->name, PRI_MAX, dispatcher, block) == TID_ERROR)
+    PANIC("Failed to start dispatcher thread for block device %s", block->name);
 
   printf("%s: %'" PRDSNu " sectors (", block->name, block->size);
   print_human_readable_size((uint64_t)block->size * BLOCK_SECTOR_SIZE);
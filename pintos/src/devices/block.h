@@ -1,8 +1,10 @@
 #ifndef DEVICES_BLOCK_H
 #define DEVICES_BLOCK_H
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <inttypes.h>
+#include <list.h>
 
 /* Size of a block device sector in bytes.
    All IDE disks use this sector size, as do most USB and SCSI
@@ -52,9 +54,36 @@ struct block* block_next(struct block*);
 block_sector_t block_size(struct block*);
 void block_read(struct block*, block_sector_t, void*);
 void block_write(struct block*, block_sector_t, const void*);
+void block_read_multiple(struct block*, block_sector_t, void* buffers[], size_t cnt);
+void block_write_multiple(struct block*, block_sector_t, void* const buffers[], size_t cnt);
 const char* block_name(struct block*);
 enum block_type block_type(struct block*);
 
+/* Asynchronous requests.
+
+   A request transfers one sector.  Requests submitted to a device
+   are queued and served by the device's dispatcher thread in
+   C-LOOK elevator order: ascending by sector from the last one
+   transferred, then back around to the lowest.  Requests for
+   consecutive sectors in the same direction are served as one
+   batch.  DONE is called from the dispatcher thread once the
+   transfer is complete; it must not block on the same device.
+   A device that passes its requests on to another one, such as a
+   partition, may change SECTOR before DONE is called. */
+struct block_request {
+  struct list_elem elem;               /* Element in the device's queue. */
+  block_sector_t sector;               /* Sector to transfer. */
+  void* buffer;                        /* BLOCK_SECTOR_SIZE bytes. */
+  bool write;                          /* Write BUFFER, or read into it? */
+  void (*done)(struct block_request*); /* Completion callback. */
+  void* aux;                           /* For DONE's use. */
+};
+
+/* Most requests the dispatcher serves as one batch. */
+#define BLOCK_BATCH_MAX 64
+
+void block_submit(struct block*, struct block_request*);
+
 /* Statistics. */
 void block_print_stats(void);
 
@@ -63,6 +92,21 @@ void block_print_stats(void);
 struct block_operations {
   void (*read)(void* aux, block_sector_t, void* buffer);
   void (*write)(void* aux, block_sector_t, const void* buffer);
+
+  /* Optional: transfer CNT consecutive sectors, starting at the
+     given one, to or from BUFFERS[0] through BUFFERS[CNT - 1],
+     each BLOCK_SECTOR_SIZE bytes.  If null, the block layer calls
+     READ or WRITE once per sector instead. */
+  void (*read_multiple)(void* aux, block_sector_t, void* buffers[], size_t cnt);
+  void (*write_multiple)(void* aux, block_sector_t, void* const buffers[], size_t cnt);
+
+  /* Optional: hand request R, already checked against the device's
+     size, to another device's queue, translating its sector as
+     needed.  If non-null, the device has no queue or dispatcher of
+     its own, the block layer never calls the operations above (which
+     may then be null), and R's callback is run by whichever device
+     serves it. */
+  void (*submit)(void* aux, struct block_request* r);
 };
 
 struct block* block_register(const char* name, enum block_type, const char* extra_info,
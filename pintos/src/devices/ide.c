@@ -5,13 +5,21 @@
 #include <stdio.h>
 #include "devices/block.h"
 #include "devices/partition.h"
+#include "devices/pci.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
-   controller.  It attempts to comply to [ATA-3]. */
+   controller.  It attempts to comply to [ATA-3].
+
+   If the controller is a PCI bus master, as the PIIX in QEMU and
+   most PCs is, transfers use DMA, so that the CPU is free while
+   the data moves; otherwise, and for buffers the controller
+   cannot reach, they fall back to PIO. */
 
 /* ATA command block port addresses. */
 #define reg_data(CHANNEL) ((CHANNEL)->reg_base + 0)   /* Data. */
@@ -34,6 +42,7 @@
 #define STA_BSY 0x80  /* Busy. */
 #define STA_DRDY 0x40 /* Device Ready. */
 #define STA_DRQ 0x08  /* Data Request. */
+#define STA_ERR 0x01  /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04 /* Software Reset. */
@@ -46,9 +55,47 @@
 /* Commands.
    Many more are defined but this is the small subset that we
    use. */
-#define CMD_IDENTIFY_DEVICE 0xec    /* IDENTIFY DEVICE. */
-#define CMD_READ_SECTOR_RETRY 0x20  /* READ SECTOR with retries. */
-#define CMD_WRITE_SECTOR_RETRY 0x30 /* WRITE SECTOR with retries. */
+#define CMD_IDENTIFY_DEVICE 0xec     /* IDENTIFY DEVICE. */
+#define CMD_SET_MULTIPLE_MODE 0xc6   /* SET MULTIPLE MODE. */
+#define CMD_READ_SECTOR_RETRY 0x20   /* READ SECTOR with retries. */
+#define CMD_READ_SECTOR_EXT 0x24     /* READ SECTOR EXT. */
+#define CMD_READ_MULTIPLE 0xc4       /* READ MULTIPLE. */
+#define CMD_READ_MULTIPLE_EXT 0x29   /* READ MULTIPLE EXT. */
+#define CMD_WRITE_SECTOR_RETRY 0x30  /* WRITE SECTOR with retries. */
+#define CMD_WRITE_SECTOR_EXT 0x34    /* WRITE SECTOR EXT. */
+#define CMD_WRITE_MULTIPLE 0xc5      /* WRITE MULTIPLE. */
+#define CMD_WRITE_MULTIPLE_EXT 0x39  /* WRITE MULTIPLE EXT. */
+#define CMD_READ_DMA 0xc8            /* READ DMA. */
+#define CMD_READ_DMA_EXT 0x25        /* READ DMA EXT. */
+#define CMD_WRITE_DMA 0xca           /* WRITE DMA. */
+#define CMD_WRITE_DMA_EXT 0x35       /* WRITE DMA EXT. */
+
+/* Bus master IDE port addresses, relative to the channel's bus
+   master base (BAR4 of the controller, plus 8 for channel 1). */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0) /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)  /* Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)    /* PRD table address. */
+
+/* Bus master command register bits. */
+#define BM_CMD_START 0x01 /* Start transfer. */
+#define BM_CMD_READ 0x08  /* Transfer from disk to memory. */
+
+/* Bus master status register bits.  Writing 1 clears them. */
+#define BM_STA_ERROR 0x02 /* Transfer failed. */
+#define BM_STA_IRQ 0x04   /* Interrupt raised. */
+
+/* Physical region descriptor: one physically contiguous piece
+   of a DMA transfer.  A region must not cross a 64 kB boundary. */
+struct prd {
+  uint32_t addr;  /* Physical address. */
+  uint16_t size;  /* Bytes, with 0 meaning 64 kB. */
+  uint16_t flags; /* PRD_EOT on the last entry. */
+};
+#define PRD_EOT 0x8000
+
+/* Most sectors transferred by one command.  A sector count of 0
+   means 256 to the LBA28 commands. */
+#define MAX_TRANSFER 256
 
 /* An ATA device. */
 struct ata_disk {
@@ -56,6 +103,10 @@ struct ata_disk {
   struct channel* channel; /* Channel that disk is attached to. */
   int dev_no;              /* Device 0 or 1 for master or slave. */
   bool is_ata;             /* Is device an ATA disk? */
+  bool lba48;              /* Supports the 48-bit LBA commands? */
+  int multiple;            /* Sectors per interrupt in READ/WRITE MULTIPLE,
+                              or 0 if those commands are not in use. */
+  bool dma;                /* Supports DMA transfers? */
 };
 
 /* An ATA channel (aka controller).
@@ -70,6 +121,9 @@ struct channel {
                                    any interrupt would be spurious. */
   struct semaphore completion_wait; /* Up'd by interrupt handler. */
 
+  uint16_t bm_base; /* Bus master base I/O port, or 0 if none. */
+  struct prd* prdt; /* PRD table, one page, if bm_base is nonzero. */
+
   struct ata_disk devices[2]; /* The devices on this channel. */
 };
 
@@ -77,13 +131,18 @@ struct channel {
 #define CHANNEL_CNT 2
 static struct channel channels[CHANNEL_CNT];
 
+bool ide_big_disks;
+
 static struct block_operations ide_operations;
 
 static void reset_channel(struct channel*);
 static bool check_device_type(struct ata_disk*);
 static void identify_ata_device(struct ata_disk*);
+static void set_multiple_mode(struct ata_disk*, uint8_t cnt);
 
-static void select_sector(struct ata_disk*, block_sector_t);
+static bool select_sectors(struct ata_disk*, block_sector_t, size_t cnt);
+static void ide_read_multiple(void*, block_sector_t, void* buffers[], size_t cnt);
+static void ide_write_multiple(void*, block_sector_t, void* const buffers[], size_t cnt);
 static void issue_pio_command(struct channel*, uint8_t command);
 static void input_sector(struct channel*, void*);
 static void output_sector(struct channel*, const void*);
@@ -95,8 +154,13 @@ static void select_device_wait(const struct ata_disk*);
 
 static void interrupt_handler(struct intr_frame*);
 
+static uint16_t find_bus_master(void);
+static bool dma_transfer(struct ata_disk*, block_sector_t, void* const buffers[], size_t cnt,
+                         bool write);
+
 /* Initialize the disk subsystem and detect disks. */
 void ide_init(void) {
+  uint16_t bm_base = find_bus_master();
   size_t chan_no;
 
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++) {
@@ -120,6 +184,13 @@ void ide_init(void) {
     lock_init(&c->lock);
     c->expecting_interrupt = false;
     sema_init(&c->completion_wait, 0);
+    c->bm_base = 0;
+    c->prdt = NULL;
+    if (bm_base != 0) {
+      c->prdt = palloc_get_page(PAL_ZERO);
+      if (c->prdt != NULL)
+        c->bm_base = bm_base + 8 * chan_no;
+    }
 
     /* Initialize devices. */
     for (dev_no = 0; dev_no < 2; dev_no++) {
@@ -128,6 +199,9 @@ void ide_init(void) {
       d->channel = c;
       d->dev_no = dev_no;
       d->is_ata = false;
+      d->lba48 = false;
+      d->multiple = 0;
+      d->dma = false;
     }
 
     /* Register interrupt handler. */
@@ -147,6 +221,26 @@ void ide_init(void) {
   }
 }
 
+/* Looks for a bus master IDE controller on the PCI bus.  If
+   there is one, enables it to master the bus and returns the base
+   I/O port of its bus master registers; otherwise returns 0. */
+static uint16_t find_bus_master(void) {
+  struct pci_dev dev;
+  uint32_t bar;
+
+  /* Mass storage controller, IDE interface, with bit 7 of the
+     programming interface saying it can be a bus master. */
+  if (!pci_find_class(0x01, 0x01, &dev) || !(pci_read_config(&dev, PCI_REG_CLASS) & 0x8000))
+    return 0;
+  bar = pci_read_config(&dev, PCI_REG_BAR(4));
+  if ((bar & 1) == 0 || (bar & ~3u) == 0)
+    return 0; /* Not in I/O space, or not set up by the BIOS. */
+
+  pci_write_config(&dev, PCI_REG_COMMAND,
+                   pci_read_config(&dev, PCI_REG_COMMAND) | PCI_CMD_IO | PCI_CMD_BUS_MASTER);
+  return bar & 0xfffc;
+}
+
 /* Disk detection and identification. */
 
 static char* descramble_ata_string(char*, int size);
@@ -257,9 +351,17 @@ static void identify_ata_device(struct ata_disk* d) {
   }
   input_sector(c, id);
 
-  /* Calculate capacity.
+  /* Calculate capacity.  Word 83 bit 10 says whether the 48-bit
+     commands are supported, in which case words 100 to 103 give
+     the full capacity; we can only address the first 2 TB of it.
      Read model name and serial number. */
   capacity = *(uint32_t*)&id[60 * 2];
+  d->lba48 = (*(uint16_t*)&id[83 * 2] & (1 << 10)) != 0;
+  d->dma = (*(uint16_t*)&id[49 * 2] & (1 << 8)) != 0;
+  if (d->lba48) {
+    uint64_t capacity48 = *(uint64_t*)&id[100 * 2];
+    capacity = capacity48 > UINT32_MAX ? UINT32_MAX : capacity48;
+  }
   model = descramble_ata_string(&id[10 * 2], 20);
   serial = descramble_ata_string(&id[27 * 2], 40);
   snprintf(extra_info, sizeof extra_info, "model \"%s\", serial \"%s\"", model, serial);
@@ -267,21 +369,44 @@ static void identify_ata_device(struct ata_disk* d) {
   /* Disable access to IDE disks over 1 GB, which are likely
      physical IDE disks rather than virtual ones.  If we don't
      allow access to those, we're less likely to scribble on
-     someone's important data.  You can disable this check by
-     hand if you really want to do so. */
-  if (capacity >= 1024 * 1024 * 1024 / BLOCK_SECTOR_SIZE) {
+     someone's important data.  The "-bigdisks" option disables
+     this check, for large virtual disks that need LBA48. */
+  if (!ide_big_disks && capacity >= 1024 * 1024 * 1024 / BLOCK_SECTOR_SIZE) {
     printf("%s: ignoring ", d->name);
-    print_human_readable_size(capacity * 512);
+    print_human_readable_size((uint64_t)capacity * BLOCK_SECTOR_SIZE);
     printf("disk for safety\n");
     d->is_ata = false;
     return;
   }
 
+  /* Low byte of word 47 is the most sectors the disk can move
+     per interrupt with READ/WRITE MULTIPLE. */
+  set_multiple_mode(d, id[47 * 2]);
+
   /* Register. */
   block = block_register(d->name, BLOCK_RAW, extra_info, capacity, &ide_operations, d);
   partition_scan(block);
 }
 
+/* Enables READ/WRITE MULTIPLE on disk D with CNT sectors per
+   interrupt, and records the setting in D.  Leaves the commands
+   disabled if CNT is 0 or the disk rejects it. */
+static void set_multiple_mode(struct ata_disk* d, uint8_t cnt) {
+  struct channel* c = d->channel;
+
+  d->multiple = 0;
+  if (cnt == 0)
+    return;
+
+  select_device_wait(d);
+  outb(reg_nsect(c), cnt);
+  issue_pio_command(c, CMD_SET_MULTIPLE_MODE);
+  sema_down(&c->completion_wait);
+  wait_while_busy(d);
+  if ((inb(reg_status(c)) & STA_ERR) == 0)
+    d->multiple = cnt;
+}
+
 /* Translates STRING, which consists of SIZE bytes in a funky
    format, into a null-terminated string in-place.  Drops
    trailing whitespace and null bytes.  Returns STRING.  */
@@ -306,21 +431,69 @@ static char* descramble_ata_string(char* string, int size) {
   return string;
 }
 
+/* Reads the CNT sectors starting at SEC_NO from disk D into
+   BUFFERS, issuing one command per MAX_TRANSFER sectors.  With
+   READ MULTIPLE the disk interrupts once per D->multiple sectors
+   rather than once per sector.  D's channel lock must be held. */
+static void read_sectors(struct ata_disk* d, block_sector_t sec_no, void* buffers[], size_t cnt) {
+  struct channel* c = d->channel;
+  size_t per_intr = d->multiple > 0 ? (size_t)d->multiple : 1;
+
+  while (cnt > 0) {
+    size_t n = cnt < MAX_TRANSFER ? cnt : MAX_TRANSFER;
+    bool ext = select_sectors(d, sec_no, n);
+
+    if (d->multiple > 0)
+      issue_pio_command(c, ext ? CMD_READ_MULTIPLE_EXT : CMD_READ_MULTIPLE);
+    else
+      issue_pio_command(c, ext ? CMD_READ_SECTOR_EXT : CMD_READ_SECTOR_RETRY);
+    for (size_t i = 0; i < n; i += per_intr) {
+      sema_down(&c->completion_wait);
+      if (!wait_while_busy(d))
+        PANIC("%s: disk read failed, sector=%" PRDSNu, d->name, sec_no + i);
+      for (size_t j = i; j < n && j < i + per_intr; j++)
+        input_sector(c, buffers[j]);
+    }
+    sec_no += n;
+    buffers += n;
+    cnt -= n;
+  }
+}
+
+/* Writes the CNT sectors starting at SEC_NO to disk D from
+   BUFFERS, as read_sectors().  D's channel lock must be held. */
+static void write_sectors(struct ata_disk* d, block_sector_t sec_no, void* const buffers[],
+                          size_t cnt) {
+  struct channel* c = d->channel;
+  size_t per_intr = d->multiple > 0 ? (size_t)d->multiple : 1;
+
+  while (cnt > 0) {
+    size_t n = cnt < MAX_TRANSFER ? cnt : MAX_TRANSFER;
+    bool ext = select_sectors(d, sec_no, n);
+
+    if (d->multiple > 0)
+      issue_pio_command(c, ext ? CMD_WRITE_MULTIPLE_EXT : CMD_WRITE_MULTIPLE);
+    else
+      issue_pio_command(c, ext ? CMD_WRITE_SECTOR_EXT : CMD_WRITE_SECTOR_RETRY);
+    for (size_t i = 0; i < n; i += per_intr) {
+      if (!wait_while_busy(d))
+        PANIC("%s: disk write failed, sector=%" PRDSNu, d->name, sec_no + i);
+      for (size_t j = i; j < n && j < i + per_intr; j++)
+        output_sector(c, buffers[j]);
+      sema_down(&c->completion_wait);
+    }
+    sec_no += n;
+    buffers += n;
+    cnt -= n;
+  }
+}
+
 /* Reads sector SEC_NO from disk D into BUFFER, which must have
    room for BLOCK_SECTOR_SIZE bytes.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
 static void ide_read(void* d_, block_sector_t sec_no, void* buffer) {
-  struct ata_disk* d = d_;
-  struct channel* c = d->channel;
-  lock_acquire(&c->lock);
-  select_sector(d, sec_no);
-  issue_pio_command(c, CMD_READ_SECTOR_RETRY);
-  sema_down(&c->completion_wait);
-  if (!wait_while_busy(d))
-    PANIC("%s: disk read failed, sector=%" PRDSNu, d->name, sec_no);
-  input_sector(c, buffer);
-  lock_release(&c->lock);
+  ide_read_multiple(d_, sec_no, &buffer, 1);
 }
 
 /* Write sector SEC_NO to disk D from BUFFER, which must contain
@@ -329,34 +502,162 @@ static void ide_read(void* d_, block_sector_t sec_no, void* buffer) {
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
 static void ide_write(void* d_, block_sector_t sec_no, const void* buffer) {
+  void* buffers[1] = {(void*)buffer};
+  ide_write_multiple(d_, sec_no, buffers, 1);
+}
+
+/* Reads the CNT sectors starting at SEC_NO from disk D into
+   BUFFERS[0] through BUFFERS[CNT - 1].
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void ide_read_multiple(void* d_, block_sector_t sec_no, void* buffers[], size_t cnt) {
   struct ata_disk* d = d_;
   struct channel* c = d->channel;
   lock_acquire(&c->lock);
-  select_sector(d, sec_no);
-  issue_pio_command(c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy(d))
-    PANIC("%s: disk write failed, sector=%" PRDSNu, d->name, sec_no);
-  output_sector(c, buffer);
-  sema_down(&c->completion_wait);
+  if (!dma_transfer(d, sec_no, buffers, cnt, false))
+    read_sectors(d, sec_no, buffers, cnt);
+  lock_release(&c->lock);
+}
+
+/* Writes the CNT sectors starting at SEC_NO to disk D from
+   BUFFERS[0] through BUFFERS[CNT - 1].  Returns after the disk
+   has acknowledged receiving all of the data.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void ide_write_multiple(void* d_, block_sector_t sec_no, void* const buffers[],
+                               size_t cnt) {
+  struct ata_disk* d = d_;
+  struct channel* c = d->channel;
+  lock_acquire(&c->lock);
+  if (!dma_transfer(d, sec_no, buffers, cnt, true))
+    write_sectors(d, sec_no, buffers, cnt);
   lock_release(&c->lock);
 }
 
-static struct block_operations ide_operations = {ide_read, ide_write};
+/* DMA transfers. */
+
+/* Returns true if the controller can move a sector to or from
+   BUFFER by DMA: it must be kernel memory, 2-byte aligned, and
+   must not cross a 64 kB boundary in physical memory. */
+static bool dma_reachable(const void* buffer) {
+  uintptr_t paddr;
+
+  if (!is_kernel_vaddr(buffer))
+    return false;
+  paddr = vtop(buffer);
+  return paddr % 2 == 0 && paddr % 0x10000 + BLOCK_SECTOR_SIZE <= 0x10000;
+}
+
+/* Fills in channel C's PRD table for the CNT sectors in BUFFERS,
+   merging physically adjacent sectors into one region where
+   the 64 kB limit allows. */
+static void fill_prdt(struct channel* c, void* const buffers[], size_t cnt) {
+  struct prd* p = NULL;
+  size_t i;
+
+  for (i = 0; i < cnt; i++) {
+    uint32_t paddr = vtop(buffers[i]);
+    if (p != NULL && p->addr + p->size == paddr && paddr % 0x10000 != 0)
+      p->size += BLOCK_SECTOR_SIZE;
+    else {
+      p = p == NULL ? c->prdt : p + 1;
+      p->addr = paddr;
+      p->size = BLOCK_SECTOR_SIZE;
+      p->flags = 0;
+    }
+  }
+  p->flags = PRD_EOT;
+}
+
+/* Transfers the CNT sectors starting at SEC_NO between disk D and
+   BUFFERS by DMA, one command per MAX_TRANSFER sectors, waiting
+   for one interrupt per command.  Returns false without doing
+   anything if D or its channel cannot do DMA, or if some buffer
+   is out of the controller's reach, in which case the caller
+   should use PIO.  D's channel lock must be held. */
+static bool dma_transfer(struct ata_disk* d, block_sector_t sec_no, void* const buffers[],
+                         size_t cnt, bool write) {
+  struct channel* c = d->channel;
+  uint8_t direction = write ? 0 : BM_CMD_READ;
+  size_t i;
+
+  if (c->bm_base == 0 || !d->dma)
+    return false;
+  for (i = 0; i < cnt; i++)
+    if (!dma_reachable(buffers[i]))
+      return false;
+
+  while (cnt > 0) {
+    size_t n = cnt < MAX_TRANSFER ? cnt : MAX_TRANSFER;
+    uint8_t bm_status;
+    bool ext;
+
+    fill_prdt(c, buffers, n);
+    outl(reg_bm_prdt(c), vtop(c->prdt));
+    outb(reg_bm_command(c), direction);
+    outb(reg_bm_status(c), inb(reg_bm_status(c)) | BM_STA_ERROR | BM_STA_IRQ);
+
+    ext = select_sectors(d, sec_no, n);
+    if (write)
+      issue_pio_command(c, ext ? CMD_WRITE_DMA_EXT : CMD_WRITE_DMA);
+    else
+      issue_pio_command(c, ext ? CMD_READ_DMA_EXT : CMD_READ_DMA);
+    outb(reg_bm_command(c), direction | BM_CMD_START);
+    sema_down(&c->completion_wait);
+    outb(reg_bm_command(c), direction);
+
+    bm_status = inb(reg_bm_status(c));
+    outb(reg_bm_status(c), bm_status | BM_STA_ERROR | BM_STA_IRQ);
+    if ((bm_status & BM_STA_ERROR) || (inb(reg_status(c)) & STA_ERR))
+      PANIC("%s: disk %s failed, sector=%" PRDSNu, d->name, write ? "write" : "read", sec_no);
+
+    sec_no += n;
+    buffers += n;
+    cnt -= n;
+  }
+  return true;
+}
+
+static struct block_operations ide_operations = {
+    .read = ide_read,
+    .write = ide_write,
+    .read_multiple = ide_read_multiple,
+    .write_multiple = ide_write_multiple,
+};
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
-static void select_sector(struct ata_disk* d, block_sector_t sec_no) {
+   writes SEC_NO and CNT, which must be between 1 and
+   MAX_TRANSFER, to the disk's sector selection registers.  (We
+   use LBA mode.)  Returns true if the transfer needs the 48-bit
+   commands because it reaches past the first 2**28 sectors. */
+static bool select_sectors(struct ata_disk* d, block_sector_t sec_no, size_t cnt) {
   struct channel* c = d->channel;
+  bool ext = sec_no + cnt > (1UL << 28);
 
-  ASSERT(sec_no < (1UL << 28));
+  ASSERT(cnt > 0 && cnt <= MAX_TRANSFER);
+  ASSERT(!ext || d->lba48);
 
   select_device_wait(d);
-  outb(reg_nsect(c), 1);
-  outb(reg_lbal(c), sec_no);
-  outb(reg_lbam(c), sec_no >> 8);
-  outb(reg_lbah(c), (sec_no >> 16));
-  outb(reg_device(c), DEV_MBS | DEV_LBA | (d->dev_no == 1 ? DEV_DEV : 0) | (sec_no >> 24));
+  if (ext) {
+    /* High-order bytes first; each register keeps the last two
+       bytes written to it. */
+    outb(reg_nsect(c), cnt >> 8);
+    outb(reg_lbal(c), sec_no >> 24);
+    outb(reg_lbam(c), 0);
+    outb(reg_lbah(c), 0);
+    outb(reg_nsect(c), cnt);
+    outb(reg_lbal(c), sec_no);
+    outb(reg_lbam(c), sec_no >> 8);
+    outb(reg_lbah(c), sec_no >> 16);
+    outb(reg_device(c), DEV_MBS | DEV_LBA | (d->dev_no == 1 ? DEV_DEV : 0));
+  } else {
+    outb(reg_nsect(c), cnt); /* 256 wraps to 0, meaning 256. */
+    outb(reg_lbal(c), sec_no);
+    outb(reg_lbam(c), sec_no >> 8);
+    outb(reg_lbah(c), (sec_no >> 16));
+    outb(reg_device(c), DEV_MBS | DEV_LBA | (d->dev_no == 1 ? DEV_DEV : 0) | (sec_no >> 24));
+  }
+  return ext;
 }
 
 /* Writes COMMAND to channel C and prepares for receiving a
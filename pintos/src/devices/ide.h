@@ -1,6 +1,12 @@
 #ifndef DEVICES_IDE_H
 #define DEVICES_IDE_H
 
+#include <stdbool.h>
+
+/* Whether to use IDE disks of 1 GB or more, which are normally
+   ignored.  Set by the "-bigdisks" kernel command-line option. */
+extern bool ide_big_disks;
+
 void ide_init(void);
 
 #endif /* devices/ide.h */
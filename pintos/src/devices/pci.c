@@ -0,0 +1,78 @@
+#include "devices/pci.h"
+#include <debug.h>
+#include "threads/interrupt.h"
+#include "threads/io.h"
+
+/* Interface to PCI configuration space, through configuration
+   mechanism #1: write the address of a 32-bit register to
+   PCI_CONFIG_ADDRESS, then access it through PCI_CONFIG_DATA.
+   See the PCI Local Bus Specification for details. */
+
+/* Configuration mechanism #1 ports. */
+#define PCI_CONFIG_ADDRESS 0xcf8
+#define PCI_CONFIG_DATA 0xcfc
+
+/* Selects register REG of DEV for the next access through
+   PCI_CONFIG_DATA. */
+static void select_register(const struct pci_dev* dev, uint8_t reg) {
+  ASSERT(dev->slot < 32 && dev->func < 8);
+  ASSERT(reg % 4 == 0);
+
+  outl(PCI_CONFIG_ADDRESS, 0x80000000 | ((uint32_t)dev->bus << 16) |
+                               ((uint32_t)dev->slot << 11) | ((uint32_t)dev->func << 8) | reg);
+}
+
+/* Returns the 32-bit configuration register at byte offset REG
+   of DEV. */
+uint32_t pci_read_config(const struct pci_dev* dev, uint8_t reg) {
+  enum intr_level old_level = intr_disable();
+  uint32_t value;
+
+  select_register(dev, reg);
+  value = inl(PCI_CONFIG_DATA);
+  intr_set_level(old_level);
+  return value;
+}
+
+/* Writes VALUE to the 32-bit configuration register at byte
+   offset REG of DEV. */
+void pci_write_config(const struct pci_dev* dev, uint8_t reg, uint32_t value) {
+  enum intr_level old_level = intr_disable();
+
+  select_register(dev, reg);
+  outl(PCI_CONFIG_DATA, value);
+  intr_set_level(old_level);
+}
+
+/* Scans every bus for a function with the given CLASS and
+   SUBCLASS codes.  If one is found, stores its location in *DEV
+   and returns true; otherwise returns false. */
+bool pci_find_class(uint8_t class, uint8_t subclass, struct pci_dev* dev) {
+  int bus, slot, func;
+
+  for (bus = 0; bus < 256; bus++)
+    for (slot = 0; slot < 32; slot++)
+      for (func = 0; func < 8; func++) {
+        uint32_t class_reg;
+
+        dev->bus = bus;
+        dev->slot = slot;
+        dev->func = func;
+        if ((pci_read_config(dev, PCI_REG_ID) & 0xffff) == 0xffff) {
+          /* No function here.  Without function 0 there are no
+             others in the slot either. */
+          if (func == 0)
+            break;
+          continue;
+        }
+
+        class_reg = pci_read_config(dev, PCI_REG_CLASS);
+        if ((class_reg >> 24) == class && ((class_reg >> 16) & 0xff) == subclass)
+          return true;
+
+        /* Only multi-function devices have functions past 0. */
+        if (func == 0 && !(pci_read_config(dev, PCI_REG_HEADER) & 0x00800000))
+          break;
+      }
+  return false;
+}
@@ -0,0 +1,29 @@
+#ifndef DEVICES_PCI_H
+#define DEVICES_PCI_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* A PCI function, identified by its position on the bus. */
+struct pci_dev {
+  uint8_t bus;  /* Bus number, 0...255. */
+  uint8_t slot; /* Device number on the bus, 0...31. */
+  uint8_t func; /* Function number within the device, 0...7. */
+};
+
+/* Configuration space registers, as byte offsets. */
+#define PCI_REG_ID 0x00      /* Vendor ID (bits 0-15), device ID. */
+#define PCI_REG_COMMAND 0x04 /* Command (bits 0-15), status. */
+#define PCI_REG_CLASS 0x08   /* Revision, prog IF, subclass, class. */
+#define PCI_REG_HEADER 0x0c  /* Header type in bits 16-23. */
+#define PCI_REG_BAR(N) (0x10 + 4 * (N))
+
+/* Command register bits. */
+#define PCI_CMD_IO 0x0001         /* Respond to I/O space accesses. */
+#define PCI_CMD_BUS_MASTER 0x0004 /* May act as bus master. */
+
+uint32_t pci_read_config(const struct pci_dev*, uint8_t reg);
+void pci_write_config(const struct pci_dev*, uint8_t reg, uint32_t value);
+bool pci_find_class(uint8_t class, uint8_t subclass, struct pci_dev*);
+
+#endif /* devices/pci.h */
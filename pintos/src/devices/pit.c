@@ -11,9 +11,6 @@
 #define PIT_PORT_CONTROL 0x43                        /* Control port. */
 #define PIT_PORT_COUNTER(CHANNEL) (0x40 + (CHANNEL)) /* Counter port. */
 
-/* PIT cycles per second. */
-#define PIT_HZ 1193180
-
 /* Configure the given CHANNEL in the PIT.  In a PC, the PIT's
    three output channels are hooked up like this:
 
@@ -75,3 +72,37 @@ void pit_configure_channel(int channel, int mode, int frequency) {
   outb(PIT_PORT_COUNTER(channel), count >> 8);
   intr_set_level(old_level);
 }
+
+/* Configures CHANNEL in mode 0, "interrupt on terminal count":
+   its output goes high, raising an interrupt for channel 0, once
+   COUNT PIT cycles have passed, and only that once.  COUNT must
+   be at least 1.  The channel keeps counting down afterward,
+   wrapping around from 0 to 65535. */
+void pit_oneshot(int channel, uint16_t count) {
+  enum intr_level old_level;
+
+  ASSERT(channel == 0 || channel == 2);
+  ASSERT(count > 0);
+
+  old_level = intr_disable();
+  outb(PIT_PORT_CONTROL, (channel << 6) | 0x30);
+  outb(PIT_PORT_COUNTER(channel), count);
+  outb(PIT_PORT_COUNTER(channel), count >> 8);
+  intr_set_level(old_level);
+}
+
+/* Returns the current value of CHANNEL's counter, which counts
+   down from the count it was last loaded with. */
+uint16_t pit_read_counter(int channel) {
+  enum intr_level old_level;
+  uint8_t low, high;
+
+  ASSERT(channel == 0 || channel == 2);
+
+  old_level = intr_disable();
+  outb(PIT_PORT_CONTROL, channel << 6); /* Latch the count. */
+  low = inb(PIT_PORT_COUNTER(channel));
+  high = inb(PIT_PORT_COUNTER(channel));
+  intr_set_level(old_level);
+  return low | (high << 8);
+}
@@ -0,0 +1,65 @@
+#include "devices/ramdisk.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* A block device held in kernel memory.  It starts out zeroed
+   and its contents are lost at shutdown, so it suits scratch
+   and swap, and file systems formatted at boot with -f.  It is
+   registered as a raw device, so it only takes a role when named
+   with -filesys, -scratch or -swap. */
+
+static struct block_operations ramdisk_operations;
+
+/* Creates a RAM disk named "rd0" of SECTORS sectors and
+   registers it with the block layer. */
+void ramdisk_init(block_sector_t sectors) {
+  size_t page_cnt = DIV_ROUND_UP(sectors, PGSIZE / BLOCK_SECTOR_SIZE);
+  void* data;
+
+  data = palloc_get_multiple(PAL_ZERO, page_cnt);
+  if (data == NULL)
+    PANIC("rd0: not enough memory for %" PRDSNu " sectors", sectors);
+  block_register("rd0", BLOCK_RAW, "RAM disk", sectors, &ramdisk_operations, data);
+}
+
+/* Returns the address of SECTOR in the RAM disk at DATA. */
+static void* sector_addr(void* data, block_sector_t sector) {
+  return (char*)data + sector * BLOCK_SECTOR_SIZE;
+}
+
+/* Reads sector SECTOR from the RAM disk at DATA into BUFFER. */
+static void ramdisk_read(void* data, block_sector_t sector, void* buffer) {
+  memcpy(buffer, sector_addr(data, sector), BLOCK_SECTOR_SIZE);
+}
+
+/* Writes sector SECTOR to the RAM disk at DATA from BUFFER. */
+static void ramdisk_write(void* data, block_sector_t sector, const void* buffer) {
+  memcpy(sector_addr(data, sector), buffer, BLOCK_SECTOR_SIZE);
+}
+
+/* Reads CNT sectors starting at SECTOR from the RAM disk at DATA
+   into BUFFERS. */
+static void ramdisk_read_multiple(void* data, block_sector_t sector, void* buffers[],
+                                  size_t cnt) {
+  for (size_t i = 0; i < cnt; i++)
+    memcpy(buffers[i], sector_addr(data, sector + i), BLOCK_SECTOR_SIZE);
+}
+
+/* Writes CNT sectors starting at SECTOR to the RAM disk at DATA
+   from BUFFERS. */
+static void ramdisk_write_multiple(void* data, block_sector_t sector, void* const buffers[],
+                                   size_t cnt) {
+  for (size_t i = 0; i < cnt; i++)
+    memcpy(sector_addr(data, sector + i), buffers[i], BLOCK_SECTOR_SIZE);
+}
+
+static struct block_operations ramdisk_operations = {
+    .read = ramdisk_read,
+    .write = ramdisk_write,
+    .read_multiple = ramdisk_read_multiple,
+    .write_multiple = ramdisk_write_multiple,
+};
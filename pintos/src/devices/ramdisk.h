@@ -0,0 +1,12 @@
+#ifndef DEVICES_RAMDISK_H
+#define DEVICES_RAMDISK_H
+
+#include "devices/block.h"
+
+/* Kernel pool pages that -ramdisk leaves free, on top of the
+   buffer cache's, for thread stacks and kernel heap. */
+#define RAMDISK_RESERVE_PAGES 256
+
+void ramdisk_init(block_sector_t sectors);
+
+#endif /* devices/ramdisk.h */
@@ -5,9 +5,13 @@
 #include "devices/serial.h"
 #include "devices/timer.h"
 #include "threads/io.h"
+#include "threads/profile.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
 #ifdef USERPROG
 #include "userprog/exception.h"
+#include "userprog/syscall.h"
 #endif
 #ifdef FILESYS
 #include "devices/block.h"
@@ -116,6 +120,9 @@ void shutdown_power_off(void) {
 static void print_stats(void) {
   timer_print_stats();
   thread_print_stats();
+  lock_print_stats();
+  profile_print_stats();
+  trace_dump();
 #ifdef FILESYS
   block_print_stats();
 #endif
@@ -123,5 +130,6 @@ static void print_stats(void) {
   kbd_print_stats();
 #ifdef USERPROG
   exception_print_stats();
+  syscall_print_stats();
 #endif
 }
@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include "devices/pit.h"
 #include "threads/interrupt.h"
+#include "threads/profile.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
 
@@ -19,11 +20,39 @@
 /* Number of timer ticks since OS booted. */
 static int64_t ticks;
 
+/* Threads blocked in timer_sleep(), in order of wake_tick, so
+   the interrupt handler only looks at threads that are due. */
+static struct list sleep_list;
+
+/* Tickless idle.  With -tickless, when only the idle thread can
+   run, the PIT is switched from periodic interrupts to one-shot
+   interrupts that stop only at the next sleeper's deadline.  Its
+   16-bit counter covers only a few ticks, so a longer idle period
+   is counted in stretches: each one-shot interrupt before the
+   deadline adds its ticks and programs the next one, without
+   waking anyone or running the scheduler's tick.  If some other
+   interrupt ends the idle period first, the ticks of the stretch
+   under way are added back from the PIT's count. */
+bool timer_tickless;
+
+/* PIT cycles per timer tick, rounded as pit_configure_channel()
+   rounds them. */
+#define PIT_PER_TICK ((PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ)
+
+/* Most ticks one PIT count can cover. */
+#define ONESHOT_MAX_TICKS (65535 / PIT_PER_TICK)
+
+static int64_t oneshot_ticks; /* Ticks the PIT is counting, or 0 if periodic. */
+static int64_t oneshot_until; /* Tick at which the idle period ends. */
+static unsigned oneshot_count; /* PIT cycles the one-shot was loaded with. */
+static unsigned pit_leftover; /* PIT cycles short of a whole tick. */
+
 /* Number of loops per timer tick.
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
 static intr_handler_func timer_interrupt;
+static void oneshot_arm(void);
 static bool too_many_loops(unsigned loops);
 static void busy_wait(int64_t loops);
 static void real_time_sleep(int64_t num, int32_t denom);
@@ -33,6 +62,7 @@ static void real_time_delay(int64_t num, int32_t denom);
    and registers the corresponding interrupt. */
 void timer_init(void) {
   pit_configure_channel(0, 2, TIMER_FREQ);
+  list_init(&sleep_list);
   intr_register_ext(0x20, timer_interrupt, "8254 Timer");
 }
 
@@ -72,14 +102,31 @@ int64_t timer_ticks(void) {
    should be a value once returned by timer_ticks(). */
 int64_t timer_elapsed(int64_t then) { return timer_ticks() - then; }
 
+/* Orders threads by the tick they are to wake at.  Equal ticks
+   compare as not less, so sleepers with the same deadline wake
+   in the order they went to sleep. */
+static bool wake_less(const struct list_elem* a_, const struct list_elem* b_, void* aux UNUSED) {
+  const struct thread* a = list_entry(a_, struct thread, elem);
+  const struct thread* b = list_entry(b_, struct thread, elem);
+  return a->wake_tick < b->wake_tick;
+}
+
 /* Sleeps for approximately TICKS timer ticks.  Interrupts must
-   be turned on. */
+   be turned on.  The thread blocks until the timer interrupt
+   wakes it, rather than taking up time in the scheduler. */
 void timer_sleep(int64_t ticks) {
-  int64_t start = timer_ticks();
+  struct thread* t = thread_current();
+  enum intr_level old_level;
 
   ASSERT(intr_get_level() == INTR_ON);
-  while (timer_elapsed(start) < ticks)
-    thread_yield();
+  if (ticks <= 0)
+    return;
+
+  old_level = intr_disable();
+  t->wake_tick = timer_ticks() + ticks;
+  list_insert_ordered(&sleep_list, &t->elem, wake_less, NULL);
+  thread_block();
+  intr_set_level(old_level);
 }
 
 /* Sleeps for approximately MS milliseconds.  Interrupts must be
@@ -122,11 +169,131 @@ void timer_ndelay(int64_t ns) { real_time_delay(ns, 1000 * 1000 * 1000); }
 void timer_print_stats(void) { printf("Timer: %" PRId64 " ticks\n", timer_ticks()); }
 
 /* Timer interrupt handler. */
-static void timer_interrupt(struct intr_frame* args UNUSED) {
-  ticks++;
+static void timer_interrupt(struct intr_frame* args) {
+  profile_sample(args);
+  if (oneshot_ticks != 0) {
+    ticks += oneshot_ticks;
+    if (ticks < oneshot_until) {
+      /* Still short of the deadline: count the next stretch.
+         Nothing is due, and the idle thread is running. */
+      oneshot_arm();
+      return;
+    }
+    /* The idle period is over: go back to periodic mode. */
+    oneshot_ticks = 0;
+    pit_configure_channel(0, 2, TIMER_FREQ);
+  } else
+    ticks++;
+
+  /* Wake the sleepers that are due, which are at the front. */
+  while (!list_empty(&sleep_list)) {
+    struct thread* t = list_entry(list_front(&sleep_list), struct thread, elem);
+    if (t->wake_tick > ticks)
+      break;
+    list_pop_front(&sleep_list);
+    thread_unblock(t);
+  }
+  /* A sleeper that outranks the running thread runs as soon as
+     the interrupt returns, not at the end of the time slice. */
+  thread_preempt();
+
   thread_tick();
 }
 
+/* Called by the idle thread, with interrupts off, just before it
+   halts the CPU.  In tickless mode, replaces the periodic timer
+   interrupt by one-shot interrupts up to the first sleeper's
+   deadline, if that is more than a tick away, or indefinitely if
+   nobody is asleep.  Does nothing if such an idle period is
+   already under way or a timer interrupt is pending. */
+void timer_idle_enter(void) {
+  int64_t until = INT64_MAX;
+  int64_t saved_ticks;
+  unsigned saved_leftover;
+
+  ASSERT(intr_get_level() == INTR_OFF);
+  if (!timer_tickless || oneshot_ticks != 0)
+    return;
+
+  if (!list_empty(&sleep_list))
+    until = list_entry(list_front(&sleep_list), struct thread, elem)->wake_tick;
+  if (until - ticks <= 1)
+    return;
+
+  /* A periodic interrupt that is already pending would be taken
+     for the end of the first one-shot stretch.  Let it count its
+     tick in periodic mode instead. */
+  if (intr_pending(0x20))
+    return;
+  saved_ticks = ticks;
+  saved_leftover = pit_leftover;
+
+  /* Part of the current tick has passed since the last periodic
+     interrupt.  Count it, carrying a whole tick if it completes
+     one with the cycles left over from earlier. */
+  pit_leftover += PIT_PER_TICK - pit_read_counter(0);
+  if (pit_leftover >= PIT_PER_TICK) {
+    ticks++;
+    pit_leftover -= PIT_PER_TICK;
+  }
+
+  oneshot_until = until;
+  oneshot_arm();
+
+  /* The one-shot cannot have run out yet, so an interrupt pending
+     now is a periodic one raised while we were arming.  Go back to
+     periodic mode and let it count its tick. */
+  if (intr_pending(0x20)) {
+    ticks = saved_ticks;
+    pit_leftover = saved_leftover;
+    oneshot_ticks = 0;
+    pit_configure_channel(0, 2, TIMER_FREQ);
+  }
+}
+
+/* Programs the PIT for the next stretch of a tickless idle
+   period: up to oneshot_until, or as far as the PIT's 16-bit
+   counter allows.  The cycles already counted toward the next
+   tick shorten the stretch, so that it ends on a tick boundary. */
+static void oneshot_arm(void) {
+  int64_t left = oneshot_until - ticks;
+
+  oneshot_ticks = left < ONESHOT_MAX_TICKS ? left : ONESHOT_MAX_TICKS;
+  oneshot_count = oneshot_ticks * PIT_PER_TICK - pit_leftover;
+  pit_leftover = 0;
+  pit_oneshot(0, oneshot_count);
+}
+
+/* Called with interrupts off by the scheduler when it switches
+   away from the idle thread.  If an interrupt other than the
+   timer's ended a tickless idle period, counts the ticks that
+   passed in the stretch under way, the earlier ones having been
+   counted by the timer interrupt, and restores the periodic timer
+   interrupt. */
+void timer_idle_exit(void) {
+  unsigned remaining, elapsed;
+
+  ASSERT(intr_get_level() == INTR_OFF);
+  if (oneshot_ticks == 0)
+    return;
+
+  remaining = pit_read_counter(0);
+  if (remaining == 0 || remaining > oneshot_count) {
+    /* The count ran out and the interrupt is still pending; it
+       will count the last tick itself once we restore periodic
+       mode. */
+    ticks += oneshot_ticks - 1;
+  } else {
+    /* Cycles since the tick boundary the stretch started from,
+       including any it was shortened by. */
+    elapsed = oneshot_ticks * PIT_PER_TICK - remaining;
+    ticks += elapsed / PIT_PER_TICK;
+    pit_leftover = elapsed % PIT_PER_TICK;
+  }
+  oneshot_ticks = 0;
+  pit_configure_channel(0, 2, TIMER_FREQ);
+}
+
 /* Returns true if LOOPS iterations waits for more than one timer
    tick, otherwise false. */
 static bool too_many_loops(unsigned loops) {
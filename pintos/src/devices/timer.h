@@ -2,6 +2,7 @@
 #define DEVICES_TIMER_H
 
 #include <round.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 /* Number of timer interrupts per second. */
@@ -24,6 +25,11 @@ void timer_mdelay(int64_t milliseconds);
 void timer_udelay(int64_t microseconds);
 void timer_ndelay(int64_t nanoseconds);
 
+/* Tickless idle. */
+extern bool timer_tickless;
+void timer_idle_enter(void);
+void timer_idle_exit(void);
+
 void timer_print_stats(void);
 
 #endif /* devices/timer.h */
@@ -1,187 +1,574 @@
 #include "filesys/buffer.h"
 #include <stddef.h>
 #include <stdio.h>
+#include <hash.h>
 #include <list.h>
 #include <debug.h>
 #include <round.h>
+#include <stdlib.h>
 #include <string.h>
+#include "devices/timer.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "filesys/inode.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
+#include "threads/vaddr.h"
+
+/* A hash bucket: the cache entries whose sector hashes here.
+   Each bucket has its own lock so that lookups of different
+   sectors do not serialize on one lock. */
+struct bucket {
+  struct list buffers; /* List of struct buffer, via hash_elem. */
+  struct lock lock;    /* Protects BUFFERS. */
+};
+
+size_t buffer_cache_sectors = BUFFER_DEFAULT_SECTORS;
+int buffer_flush_ms = BUFFER_DEFAULT_FLUSH_MS;
+int buffer_dirty_pct = BUFFER_DEFAULT_DIRTY_PCT;
+
+static struct buffer* cache;       /* Array of cache_cnt entries. */
+static size_t cache_cnt;           /* Number of entries in cache. */
+static struct bucket* buckets;     /* Array of bucket_cnt buckets. */
+static size_t bucket_cnt;          /* Number of buckets, a power of 2. */
+static size_t clock_hand;          /* Next entry the clock will look at. */
+static struct lock lru_permission; // dont want threads moving the clock hand at the same time
+
+/* Write-behind state. */
+static size_t dirty_cnt;            /* Number of dirty entries. */
+static bool flush_requested;        /* Set when a flush is wanted before the interval. */
+static bool flush_interval_passed;    /* Set by the ticker once per interval. */
+static struct semaphore flush_wakeup; /* Upped to wake the flusher. */
+static int64_t flush_interval;        /* Ticks between periodic flushes. */
+static struct buffer** flush_order; /* Scratch array for sorting dirty entries. */
+static struct block_request* flush_reqs; /* One write request per entry. */
+static struct lock flush_lock;           /* One write-back pass at a time. */
+
+/* Read-ahead state.  buffer_prefetch() queues sectors here and
+   the read-ahead thread brings them into the cache. */
+#define READAHEAD_QUEUE 64
+#define READAHEAD_BATCH 8 /* Sectors submitted to the disk at once. */
+static block_sector_t ra_queue[READAHEAD_QUEUE]; /* Ring of sectors to load. */
+static size_t ra_head, ra_cnt;                   /* First queued slot, queue length. */
+static struct lock ra_lock;                      /* Protects the queue. */
+static struct condition ra_nonempty;             /* Signaled when a sector is queued. */
 
-static struct buffer cache[64];
-static struct list cache_list;
-static struct lock lru_permission; // dont want threads changing order at the same time
 void write_back(struct buffer*);
-void acquire_entry(block_sector_t);
+static bool is_cached(block_sector_t);
+static void readahead(void*);
+static void set_dirty(struct buffer*, int);
+static void flush_dirty(bool wait);
+static void request_flush(void);
+static void flusher(void*);
+static void flush_ticker(void*);
+static struct buffer* acquire_entry(block_sector_t, bool load, bool shared);
+static struct buffer* insert_entry(struct bucket*, block_sector_t);
+static struct buffer* claim_victim(void);
+
+/* Lock ordering: an entry's change_data lock may be held while
+   acquiring a bucket lock, never the other way around.  The clock
+   only try-acquires change_data, so it never waits on a user.
+   change_data is a reader-writer lock: threads that only read an
+   entry share it, and write-back only needs it shared too, while
+   modifying or recycling an entry takes it exclusively. */
+
+/* Returns the number of kernel pages a cache of SECTORS sectors
+   takes: its entries and their sector data, which come straight
+   from the page allocator, plus the write-back scratch arrays,
+   counted in whole pages since malloc() hands out large blocks
+   that way. */
+size_t buffer_cache_pages(size_t sectors) {
+  size_t entry_pages = DIV_ROUND_UP(sectors * sizeof *cache, PGSIZE);
+  size_t data_pages = DIV_ROUND_UP(sectors * BLOCK_SECTOR_SIZE, PGSIZE);
+  size_t scratch_pages = DIV_ROUND_UP(sectors * sizeof *flush_order, PGSIZE) +
+                         DIV_ROUND_UP(sectors * sizeof *flush_reqs, PGSIZE);
+  return entry_pages + data_pages + scratch_pages;
+}
 
 void buffer_init() {
-  for (int i = 0; i < 64; i++) {
+  size_t entry_pages, data_pages;
+  char* data;
+
+  cache_cnt = buffer_cache_sectors;
+  if (cache_cnt < BUFFER_MIN_SECTORS)
+    PANIC("buffer cache needs at least %d sectors", BUFFER_MIN_SECTORS);
+
+  /* Entries and their sector data come straight from the page
+     allocator, so the cache can be sized to the machine.  The
+     "-cache" option was checked against buffer_cache_pages(). */
+  entry_pages = DIV_ROUND_UP(cache_cnt * sizeof *cache, PGSIZE);
+  data_pages = DIV_ROUND_UP(cache_cnt * BLOCK_SECTOR_SIZE, PGSIZE);
+  cache = palloc_get_multiple(PAL_ASSERT | PAL_ZERO, entry_pages);
+  data = palloc_get_multiple(PAL_ASSERT | PAL_ZERO, data_pages);
+
+  /* Two to four entries per bucket. */
+  for (bucket_cnt = 1; bucket_cnt * 4 <= cache_cnt; bucket_cnt *= 2)
+    continue;
+  buckets = malloc(bucket_cnt * sizeof *buckets);
+  if (buckets == NULL)
+    PANIC("buffer cache: out of memory");
+  for (size_t i = 0; i < bucket_cnt; i++) {
+    list_init(&buckets[i].buffers);
+    lock_init(&buckets[i].lock);
+    lock_set_name(&buckets[i].lock, "buffer_bucket");
+  }
+
+  for (size_t i = 0; i < cache_cnt; i++) {
+    cache[i].data = data + i * BLOCK_SECTOR_SIZE;
     cache[i].valid = 0;
     cache[i].dirty = 0;
-    lock_init(&cache[i].change_data);
+    cache[i].accessed = false;
+    rwlock_init(&cache[i].change_data);
   }
-  list_init(&cache_list);
-  list_size(&cache_list);
+  clock_hand = 0;
   lock_init(&lru_permission);
+  lock_set_name(&lru_permission, "lru_permission");
+
+  dirty_cnt = 0;
+  flush_requested = false;
+  flush_interval_passed = false;
+  sema_init(&flush_wakeup, 0);
+  flush_interval = (int64_t)buffer_flush_ms * TIMER_FREQ / 1000;
+  if (flush_interval < 1)
+    flush_interval = 1;
+  flush_order = malloc(cache_cnt * sizeof *flush_order);
+  flush_reqs = malloc(cache_cnt * sizeof *flush_reqs);
+  if (flush_order == NULL || flush_reqs == NULL)
+    PANIC("buffer cache: out of memory");
+  lock_init(&flush_lock);
+  lock_set_name(&flush_lock, "flush_lock");
+  thread_create("flusher", PRI_DEFAULT, flusher, NULL);
+  thread_create("flush_ticker", PRI_DEFAULT, flush_ticker, NULL);
+
+  ra_head = ra_cnt = 0;
+  lock_init(&ra_lock);
+  cond_init(&ra_nonempty);
+  thread_create("readahead", PRI_DEFAULT, readahead, NULL);
 }
 
 void write_back(struct buffer* b) {
-  block_write(fs_device, b->sect_num, &b->data);
-  b->dirty = 0;
+  block_write(fs_device, b->sect_num, b->data);
+  set_dirty(b, 0);
 }
 
-void acquire_entry(block_sector_t sect_num) { return; }
+/* Sets B's dirty bit to DIRTY, keeping dirty_cnt in step, and
+   wakes the flusher once too much of the cache is dirty.  B's
+   change_data lock must be held, at least shared. */
+static void set_dirty(struct buffer* b, int dirty) {
+  enum intr_level old_level;
+  bool too_dirty;
 
-void buffer_read(struct block* block, block_sector_t sect_num, void* buf) {
-  lock_acquire(&lru_permission);
-  bool again = true;
-  while (again) {
-    again = false;
-    for (int i = 0; i < 64; i++) {
-      if (cache[i].sect_num == sect_num && cache[i].valid == 1) { // cache hit
-        lock_release(&lru_permission);
-
-        lock_acquire(&cache[i].change_data);
-        if (cache[i].sect_num == sect_num) {
-          memcpy(buf, &cache[i].data, BLOCK_SECTOR_SIZE);
-          lock_release(&cache[i].change_data);
-          /*move to front*/
-          lock_acquire(&lru_permission);
-          list_remove(&cache[i].elem);
-          list_push_front(&cache_list, &cache[i].elem);
-          lock_release(&lru_permission);
-          return;
-        }
-        lock_release(&cache[i].change_data);
-        lock_acquire(&lru_permission);
-        again = true; /*try again */
-      }
-    }
+  if (b->dirty == dirty)
+    return;
+  old_level = intr_disable();
+  b->dirty = dirty;
+  if (dirty)
+    dirty_cnt++;
+  else
+    dirty_cnt--;
+  too_dirty = dirty && dirty_cnt * 100 > cache_cnt * buffer_dirty_pct;
+  intr_set_level(old_level);
+
+  if (too_dirty)
+    request_flush();
+}
+
+/* Wakes the flusher to write dirty entries back now rather than
+   at the end of the interval.  Requests made before the flusher
+   gets to run are folded into one. */
+static void request_flush(void) {
+  enum intr_level old_level = intr_disable();
+  bool wake = !flush_requested;
+
+  flush_requested = true;
+  intr_set_level(old_level);
+  if (wake)
+    sema_up(&flush_wakeup);
+}
+
+/* qsort() comparison function that orders cache entries by
+   sector number. */
+static int compare_sectors(const void* a_, const void* b_) {
+  const struct buffer* a = *(struct buffer* const*)a_;
+  const struct buffer* b = *(struct buffer* const*)b_;
+  return a->sect_num < b->sect_num ? -1 : a->sect_num > b->sect_num;
+}
+
+/* Completion callback for write-back requests. */
+static void request_done(struct block_request* r) { sema_up(r->aux); }
+
+/* Writes every dirty entry back to disk.  The entries that are
+   not in use are pinned and submitted to the disk together, so the
+   block layer can sort and merge them into a few long writes, and
+   the flush waits once for all of them.  Entries that are being
+   modified are written back afterward, one at a time, if WAIT is
+   true, and otherwise left for the next flush.  Entries are only
+   held shared, so readers are not held up by write-back. */
+static void flush_dirty(bool wait) {
+  struct semaphore done;
+  size_t cnt = 0, batched = 0;
+
+  lock_acquire(&flush_lock);
+  flush_requested = false;
+  for (size_t i = 0; i < cache_cnt; i++)
+    if (cache[i].valid == 1 && cache[i].dirty == 1)
+      flush_order[cnt++] = &cache[i];
+  qsort(flush_order, cnt, sizeof *flush_order, compare_sectors);
+
+  sema_init(&done, 0);
+  for (size_t i = 0; i < cnt; i++) {
+    struct buffer* b = flush_order[i];
+    if (!rwlock_try_acquire_read(&b->change_data))
+      continue;
+    if (b->valid == 1 && b->dirty == 1) { // may have been evicted meanwhile
+      struct block_request* r = &flush_reqs[batched];
+      r->sector = b->sect_num;
+      r->buffer = b->data;
+      r->write = true;
+      r->done = request_done;
+      r->aux = &done;
+      block_submit(fs_device, r);
+      flush_order[batched++] = b;
+    } else
+      rwlock_release(&b->change_data);
   }
-  // code below handles a cache miss
-  /* if hair pulling occurs, remove locks below for blocks */
-  struct buffer* b;
-  if (list_size(&cache_list) == 64) { // evict LRU if cache list is full
-    b = list_entry(list_pop_back(&cache_list), struct buffer, elem);
-    lock_acquire(&b->change_data);
-  } else { // create new buffer entry
-    for (int i = 0; i < 64; i++) {
-      b = &cache[i];
-      lock_acquire(&b->change_data);
-      if (b->valid == 0) {
-        break;
-      }
-      lock_release(&b->change_data);
+  for (size_t i = 0; i < batched; i++)
+    sema_down(&done);
+  for (size_t i = 0; i < batched; i++) {
+    set_dirty(flush_order[i], 0);
+    rwlock_release(&flush_order[i]->change_data);
+  }
+
+  if (wait)
+    for (size_t i = 0; i < cache_cnt; i++) {
+      struct buffer* b = &cache[i];
+      if (b->dirty == 0)
+        continue;
+      rwlock_acquire_read(&b->change_data);
+      if (b->valid == 1 && b->dirty == 1)
+        write_back(b);
+      rwlock_release(&b->change_data);
     }
+  lock_release(&flush_lock);
+}
+
+/* Write-behind thread.  Sleeps until it is woken, either by the
+   flush ticker once per flush interval or by request_flush() when
+   too much of the cache is dirty or eviction ran into dirty
+   entries.  The periodic pass also writes the metadata of open
+   inodes and the free map into the cache before flushing it.
+   Entries skipped because they were in use wait for the next
+   pass. */
+static void flusher(void* aux UNUSED) {
+  for (;;) {
+    enum intr_level old_level;
+    bool periodic, requested;
+
+    sema_down(&flush_wakeup);
+    old_level = intr_disable();
+    periodic = flush_interval_passed;
+    requested = flush_requested;
+    flush_interval_passed = flush_requested = false;
+    intr_set_level(old_level);
+
+    if (periodic) {
+      // pull in metadata of open inodes and the free map
+      inode_flush_all();
+      free_map_flush();
+    }
+    if (dirty_cnt > 0 &&
+        (periodic || requested || dirty_cnt * 100 > cache_cnt * buffer_dirty_pct))
+      flush_dirty(false);
   }
-  if (b->dirty == 1) { // if evicted block has dirty bit, write back to disk
-    write_back(b);
+}
+
+/* Wakes the flusher once every flush interval.  This is the
+   flusher's only timed wakeup. */
+static void flush_ticker(void* aux UNUSED) {
+  for (;;) {
+    timer_sleep(flush_interval);
+    flush_interval_passed = true;
+    sema_up(&flush_wakeup);
   }
-  b->dirty = 0;
-  b->valid = 1;
-  b->sect_num = sect_num;
-  block_read(fs_device, sect_num, &b->data); // actually read from disk
-  memcpy(buf, &b->data, BLOCK_SECTOR_SIZE);
-  lock_release(&b->change_data);
-  list_push_front(&cache_list, &b->elem);
-  lock_release(&lru_permission);
 }
 
-void buffer_write(struct block* block, block_sector_t sect_num, void* buf) {
-  // same algorithm, except with block_write instead of block_read
-  // need to set the dirty bit of the cache entry if we find it in cache
-  lock_acquire(&lru_permission);
-  bool again = true;
-  while (again) {
-    again = false;
-    for (int i = 0; i < 64; i++) {
-      if (cache[i].sect_num == sect_num && cache[i].valid == 1) { // cache hit
-        lock_release(&lru_permission);
-
-        lock_acquire(&cache[i].change_data);
-        if (cache[i].sect_num == sect_num) {
-          memcpy(cache[i].data, buf, BLOCK_SECTOR_SIZE);
-          cache[i].dirty = true;
-          lock_release(&cache[i].change_data);
-          /*move to front*/
-          lock_acquire(&lru_permission);
-          list_remove(&cache[i].elem);
-          list_push_front(&cache_list, &cache[i].elem);
-          lock_release(&lru_permission);
-          return;
-        }
-        lock_release(&cache[i].change_data);
-        lock_acquire(&lru_permission);
-        again = true; /*try again */
-      }
-    }
+/* Returns the hash bucket for SECT_NUM. */
+static struct bucket* sector_bucket(block_sector_t sect_num) {
+  return &buckets[hash_int(sect_num) & (bucket_cnt - 1)];
+}
+
+/* Returns the valid entry in BK holding SECT_NUM, or a null
+   pointer if there is none.  BK's lock must be held. */
+static struct buffer* bucket_find(struct bucket* bk, block_sector_t sect_num) {
+  struct list_elem* e;
+  for (e = list_begin(&bk->buffers); e != list_end(&bk->buffers); e = list_next(e)) {
+    struct buffer* b = list_entry(e, struct buffer, hash_elem);
+    if (b->sect_num == sect_num)
+      return b;
   }
-  // code below handles a cache miss
-  /* if hair pulling occurs, remove locks below for blocks */
+  return NULL;
+}
+
+/* Runs the clock hand until it finds an entry that is free, or
+   that nobody is using and that has not been used since the hand
+   last passed it, and returns it with its change_data lock held
+   exclusively.
+   Dirty entries are passed over, and handed to the flusher, until
+   the hand has gone around twice without finding a clean one.
+   If the entry held a sector, that sector is written back if
+   dirty and dropped from its bucket. */
+static struct buffer* claim_victim(void) {
   struct buffer* b;
-  if (list_size(&cache_list) == 64) { // evict LRU if cache list is full
-    b = list_entry(list_pop_back(&cache_list), struct buffer, elem);
-    lock_acquire(&b->change_data);
-  } else { // create new buffer entry
-    for (int i = 0; i < 64; i++) {
-      b = &cache[i];
-      lock_acquire(&b->change_data);
-      if (b->valid == 0) {
+  size_t steps = 0;
+
+  lock_acquire(&lru_permission);
+  for (;;) {
+    b = &cache[clock_hand];
+    clock_hand = (clock_hand + 1) % cache_cnt;
+    if (rwlock_try_acquire_write(&b->change_data)) {
+      if (b->valid == 0)
         break;
-      }
-      lock_release(&b->change_data);
+      if (!b->accessed && (b->dirty == 0 || steps >= 2 * cache_cnt))
+        break;
+      if (b->dirty == 1)
+        request_flush();
+      b->accessed = false; /* second chance */
+      rwlock_release(&b->change_data);
+    }
+    if (++steps >= 3 * cache_cnt) {
+      /* Every entry is in use, let someone finish. */
+      lock_release(&lru_permission);
+      thread_yield();
+      lock_acquire(&lru_permission);
+      steps = 0;
     }
   }
-  if (b->dirty == 1) { // if evicted block has dirty bit, write back to disk
-    write_back(b);
+  lock_release(&lru_permission);
+
+  if (b->valid == 1) {
+    struct bucket* old = sector_bucket(b->sect_num);
+    if (b->dirty == 1) // if evicted block has dirty bit, write back to disk
+      write_back(b);
+    lock_acquire(&old->lock);
+    list_remove(&b->hash_elem);
+    b->valid = 0;
+    lock_release(&old->lock);
+  }
+  return b;
+}
+
+/* Returns true if SECT_NUM is currently in the cache. */
+static bool is_cached(block_sector_t sect_num) {
+  struct bucket* bk = sector_bucket(sect_num);
+  bool found;
+
+  lock_acquire(&bk->lock);
+  found = bucket_find(bk, sect_num) != NULL;
+  lock_release(&bk->lock);
+  return found;
+}
+
+/* Claims an entry for SECT_NUM, which hashes to BK, and inserts
+   it into BK without reading the sector.  Returns the entry with
+   its change_data lock held exclusively, or a null pointer if
+   another thread brought the sector into the cache meanwhile. */
+static struct buffer* insert_entry(struct bucket* bk, block_sector_t sect_num) {
+  struct buffer* b = claim_victim();
+
+  lock_acquire(&bk->lock);
+  if (bucket_find(bk, sect_num) != NULL) {
+    lock_release(&bk->lock);
+    rwlock_release(&b->change_data);
+    return NULL;
   }
   b->sect_num = sect_num;
-  b->dirty = 1;
+  b->dirty = 0;
   b->valid = 1;
-  //block_write(fs_device, sect_num, &b->data); // actually read from disk
-  memcpy(&b->data, buf, BLOCK_SECTOR_SIZE);
-  lock_release(&b->change_data);
-  list_push_front(&cache_list, &b->elem);
-  lock_release(&lru_permission);
+  b->accessed = true;
+  list_push_front(&bk->buffers, &b->hash_elem);
+  lock_release(&bk->lock);
+  return b;
 }
 
-void buffer_evict(block_sector_t sect_num) {
-  lock_acquire(&lru_permission);
-  bool again = true;
-  while (again) {
-    again = false;
-    for (int i = 0; i < 64; i++) {
-      if (cache[i].sect_num == sect_num && cache[i].valid == 1) { // cache hit
-        lock_release(&lru_permission);
-
-        lock_acquire(&cache[i].change_data);
-        if (cache[i].sect_num == sect_num) {
-          cache[i].valid = 0;
-          lock_release(&cache[i].change_data);
-          /*move to front*/
-          lock_acquire(&lru_permission);
-          list_remove(&cache[i].elem);
-          lock_release(&lru_permission);
-          if (cache[i].dirty == 1)
-            write_back(&cache[i]);
-          cache[i].dirty = 0;
-          return;
-        }
-        lock_release(&cache[i].change_data);
-        lock_acquire(&lru_permission);
-        again = true; /*try again */
+/* Returns the cache entry for SECT_NUM with its change_data lock
+   held, shared if SHARED is true and exclusively otherwise,
+   bringing the sector into the cache on a miss.  The sector is
+   only read from disk if LOAD is true; otherwise the caller must
+   overwrite the whole entry. */
+static struct buffer* acquire_entry(block_sector_t sect_num, bool load, bool shared) {
+  struct bucket* bk = sector_bucket(sect_num);
+  struct buffer* b;
+
+  for (;;) {
+    lock_acquire(&bk->lock);
+    b = bucket_find(bk, sect_num);
+    lock_release(&bk->lock);
+
+    if (b != NULL) { // cache hit
+      if (shared)
+        rwlock_acquire_read(&b->change_data);
+      else
+        rwlock_acquire_write(&b->change_data);
+      if (b->valid == 1 && b->sect_num == sect_num) {
+        b->accessed = true;
+        TRACE(TRACE_CACHE_HIT, sect_num, 0, 0);
+        return b;
       }
+      rwlock_release(&b->change_data);
+      continue; /* entry was recycled, try again */
     }
+
+    // code below handles a cache miss
+    b = insert_entry(bk, sect_num);
+    if (b == NULL)
+      continue; /* someone else brought the sector in, use theirs */
+    TRACE(TRACE_CACHE_MISS, sect_num, 0, 0);
+
+    if (load)
+      block_read(fs_device, sect_num, b->data); // actually read from disk
+    if (shared)
+      rwlock_downgrade(&b->change_data); // let other readers in once loaded
+    return b;
   }
 }
 
-void buffer_flush() { // called during filesys_done
-  for (int i = 0; i < 64; i++) {
-    cache[i].valid = 0;
-    if (cache[i].dirty == 1) {
-      write_back(&cache[i]); // write the entire cache
+/* Pins the cache entry for sector SECT_NUM and returns it.  The
+   caller may read and modify the BLOCK_SECTOR_SIZE bytes at the
+   entry's data in place until it calls buffer_put(), and must
+   call buffer_mark_dirty() if it modified them.  If LOAD is false
+   the sector is not read from disk on a miss, so the caller must
+   overwrite all of it.  Other threads that want the same sector
+   wait until it is put back. */
+struct buffer* buffer_get(struct block* block UNUSED, block_sector_t sect_num, bool load) {
+  return acquire_entry(sect_num, load, false);
+}
+
+/* Like buffer_get(), but pins the entry for reading only, so any
+   number of threads can hold the same sector at once.  The
+   caller must not modify the entry's data. */
+struct buffer* buffer_get_shared(struct block* block UNUSED, block_sector_t sect_num) {
+  return acquire_entry(sect_num, true, true);
+}
+
+/* Marks pinned entry B as modified, so it is written back.  B
+   must have been returned by buffer_get(). */
+void buffer_mark_dirty(struct buffer* b) {
+  ASSERT(rwlock_held_by_current_thread(&b->change_data));
+  set_dirty(b, 1);
+}
+
+/* Unpins B, which must have been returned by buffer_get() or
+   buffer_get_shared(). */
+void buffer_put(struct buffer* b) { rwlock_release(&b->change_data); }
+
+void buffer_read(struct block* block, block_sector_t sect_num, void* buf) {
+  struct buffer* b = buffer_get_shared(block, sect_num);
+  memcpy(buf, b->data, BLOCK_SECTOR_SIZE);
+  buffer_put(b);
+}
+
+void buffer_write(struct block* block, block_sector_t sect_num, void* buf) {
+  // whole sector is overwritten, so a miss need not read the disk
+  struct buffer* b = buffer_get(block, sect_num, false);
+  memcpy(b->data, buf, BLOCK_SECTOR_SIZE);
+  buffer_mark_dirty(b);
+  buffer_put(b);
+}
+
+/* Asks the read-ahead thread to bring SECT_NUM into the cache
+   and returns without waiting.  The request is dropped if the
+   sector is already cached or the queue is full. */
+void buffer_prefetch(block_sector_t sect_num) {
+  if (is_cached(sect_num))
+    return;
+  lock_acquire(&ra_lock);
+  if (ra_cnt < READAHEAD_QUEUE) {
+    ra_queue[(ra_head + ra_cnt++) % READAHEAD_QUEUE] = sect_num;
+    cond_signal(&ra_nonempty, &ra_lock);
+  }
+  lock_release(&ra_lock);
+}
+
+/* Read-ahead thread.  Loads queued sectors into the cache so that
+   sequential readers find them there.  Takes up to READAHEAD_BATCH
+   sectors at a time and submits the reads for those not already
+   cached together, so the disk can serve them in one sweep. */
+static void readahead(void* aux UNUSED) {
+  struct block_request reqs[READAHEAD_BATCH];
+  struct buffer* pinned[READAHEAD_BATCH];
+  struct semaphore done;
+
+  sema_init(&done, 0);
+  for (;;) {
+    block_sector_t sectors[READAHEAD_BATCH];
+    size_t cnt = 0, submitted = 0;
+
+    lock_acquire(&ra_lock);
+    while (ra_cnt == 0)
+      cond_wait(&ra_nonempty, &ra_lock);
+    for (; cnt < READAHEAD_BATCH && ra_cnt > 0; cnt++) {
+      sectors[cnt] = ra_queue[ra_head];
+      ra_head = (ra_head + 1) % READAHEAD_QUEUE;
+      ra_cnt--;
+    }
+    lock_release(&ra_lock);
+
+    for (size_t i = 0; i < cnt; i++) {
+      struct bucket* bk = sector_bucket(sectors[i]);
+      struct buffer* b;
+
+      if (is_cached(sectors[i]))
+        continue;
+      b = insert_entry(bk, sectors[i]);
+      if (b == NULL)
+        continue;
+      reqs[submitted].sector = sectors[i];
+      reqs[submitted].buffer = b->data;
+      reqs[submitted].write = false;
+      reqs[submitted].done = request_done;
+      reqs[submitted].aux = &done;
+      block_submit(fs_device, &reqs[submitted]);
+      pinned[submitted++] = b;
     }
+    for (size_t i = 0; i < submitted; i++)
+      sema_down(&done);
+    for (size_t i = 0; i < submitted; i++)
+      rwlock_release(&pinned[i]->change_data);
+  }
+}
+
+void buffer_evict(block_sector_t sect_num) {
+  struct bucket* bk = sector_bucket(sect_num);
+  struct buffer* b;
+
+  lock_acquire(&bk->lock);
+  b = bucket_find(bk, sect_num);
+  lock_release(&bk->lock);
+  if (b == NULL)
+    return;
+
+  rwlock_acquire_write(&b->change_data);
+  if (b->valid != 1 || b->sect_num != sect_num) {
+    rwlock_release(&b->change_data);
+    return;
   }
+  if (b->dirty == 1)
+    write_back(b);
+  lock_acquire(&bk->lock);
+  list_remove(&b->hash_elem);
+  b->valid = 0;
+  lock_release(&bk->lock);
+  rwlock_release(&b->change_data);
+}
+
+/* Writes back whatever the flusher has not gotten to yet,
+   including the cached metadata of open inodes and the free map.
+   Called on exit, halt and shutdown. */
+void buffer_flush() {
+  inode_flush_all();
+  free_map_flush();
+  flush_dirty(true);
 }
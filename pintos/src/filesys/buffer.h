@@ -1,22 +1,64 @@
 #ifndef FILESYS_BUFFER_H
 #define FILESYS_BUFFER_H
 
+#include <stddef.h>
 #include "devices/block.h"
 #include "threads/synch.h"
 
+/* Default number of sectors held by the buffer cache.  Can be
+   overridden with the "-cache" kernel command-line option. */
+#define BUFFER_DEFAULT_SECTORS 64
+
+/* Smallest cache we can run with: every thread that can be in
+   the middle of a file system call may hold a few entries. */
+#define BUFFER_MIN_SECTORS 16
+
+/* Kernel pool pages that the "-cache" option leaves free, on
+   top of the cache's own, for thread stacks and kernel heap. */
+#define BUFFER_RESERVE_PAGES 256
+
 struct buffer {
   block_sector_t sect_num;
-  char data[BLOCK_SECTOR_SIZE];
-  struct lock change_data;
+  char* data; /* BLOCK_SECTOR_SIZE bytes of palloc'd memory. */
+  struct rwlock change_data; /* Shared by readers, exclusive for writers. */
   int dirty;
   int valid;
-  struct list_elem elem;
+  bool accessed;              /* Reference bit for the clock hand. */
+  struct list_elem hash_elem; /* Element in sector hash bucket. */
 };
 
+/* Default write-behind tunables.  Dirty entries are written back
+   every BUFFER_DEFAULT_FLUSH_MS milliseconds, or sooner once more
+   than BUFFER_DEFAULT_DIRTY_PCT percent of the cache is dirty.
+   Overridden with the "-flush" and "-dirty" options. */
+#define BUFFER_DEFAULT_FLUSH_MS 1000
+#define BUFFER_DEFAULT_DIRTY_PCT 50
+
+/* Ranges the "-flush" and "-dirty" options accept.  The shortest
+   interval is one timer tick at the default TIMER_FREQ. */
+#define BUFFER_MIN_FLUSH_MS 10
+#define BUFFER_MAX_FLUSH_MS 60000
+#define BUFFER_MIN_DIRTY_PCT 1
+#define BUFFER_MAX_DIRTY_PCT 100
+
+/* Cache tunables, set from the command line. */
+extern size_t buffer_cache_sectors;
+extern int buffer_flush_ms;
+extern int buffer_dirty_pct;
+
+size_t buffer_cache_pages(size_t sectors);
 void buffer_init(void);
 void buffer_read(struct block*, block_sector_t, void*);
 void buffer_write(struct block*, block_sector_t, void*);
+
+/* Zero-copy access: pin a sector, use its data in place, unpin. */
+struct buffer* buffer_get(struct block*, block_sector_t, bool load);
+struct buffer* buffer_get_shared(struct block*, block_sector_t);
+void buffer_mark_dirty(struct buffer*);
+void buffer_put(struct buffer*);
+
 void buffer_flush(void);
 void buffer_evict(block_sector_t);
+void buffer_prefetch(block_sector_t);
 
 #endif
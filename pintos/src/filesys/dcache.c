@@ -0,0 +1,159 @@
+#include "filesys/dcache.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* Directory entry cache.
+
+   Maps a (parent directory sector, name) pair to the sector of
+   the named inode, or to DCACHE_NONE when the name is known to be
+   absent, so that path resolution can skip reading directory
+   blocks.  Entries are dropped least recently used first once
+   there are DCACHE_MAX_ENTRIES of them.
+
+   Directory changes invalidate entries through dcache_invalidate()
+   and dcache_invalidate_dir().  Each invalidation bumps a
+   generation counter; a lookup that missed takes the generation
+   before reading the directory and passes it to dcache_insert(),
+   which drops the entry if anything was invalidated meanwhile, so
+   a stale result is never cached. */
+
+/* A cached directory entry. */
+struct dentry {
+  struct hash_elem hash_elem; /* Element in dentries. */
+  struct list_elem lru_elem;  /* Element in lru, most recent first. */
+  block_sector_t parent;      /* Sector of the containing directory. */
+  block_sector_t sector;      /* Inode sector, or DCACHE_NONE. */
+  char name[NAME_MAX + 1];    /* Null terminated file name. */
+};
+
+static struct hash dentries;
+static struct list lru;
+static struct lock dcache_lock; /* Protects all of the above. */
+static unsigned generation;     /* Bumped by every invalidation. */
+
+static unsigned dentry_hash(const struct hash_elem* e, void* aux UNUSED) {
+  const struct dentry* d = hash_entry(e, struct dentry, hash_elem);
+  return hash_string(d->name) ^ hash_int(d->parent);
+}
+
+static bool dentry_less(const struct hash_elem* a_, const struct hash_elem* b_, void* aux UNUSED) {
+  const struct dentry* a = hash_entry(a_, struct dentry, hash_elem);
+  const struct dentry* b = hash_entry(b_, struct dentry, hash_elem);
+  if (a->parent != b->parent)
+    return a->parent < b->parent;
+  return strcmp(a->name, b->name) < 0;
+}
+
+/* Initializes the directory entry cache. */
+void dcache_init(void) {
+  hash_init(&dentries, dentry_hash, dentry_less, NULL);
+  list_init(&lru);
+  lock_init(&dcache_lock);
+  lock_set_name(&dcache_lock, "dcache_lock");
+}
+
+/* Returns the cached entry for NAME in PARENT, or a null pointer.
+   dcache_lock must be held. */
+static struct dentry* find(block_sector_t parent, const char* name) {
+  struct dentry key;
+  struct hash_elem* e;
+
+  if (strlen(name) > NAME_MAX)
+    return NULL;
+  key.parent = parent;
+  strlcpy(key.name, name, sizeof key.name);
+  e = hash_find(&dentries, &key.hash_elem);
+  return e != NULL ? hash_entry(e, struct dentry, hash_elem) : NULL;
+}
+
+/* Removes D from the cache and frees it.  dcache_lock must be
+   held. */
+static void discard(struct dentry* d) {
+  hash_delete(&dentries, &d->hash_elem);
+  list_remove(&d->lru_elem);
+  free(d);
+}
+
+/* Looks up NAME in the directory whose inode is in PARENT.
+   Returns false on a miss.  On a hit, returns true and sets
+   *SECTOR to the inode sector, or to DCACHE_NONE if NAME is
+   known not to exist. */
+bool dcache_lookup(block_sector_t parent, const char* name, block_sector_t* sector) {
+  struct dentry* d;
+
+  lock_acquire(&dcache_lock);
+  d = find(parent, name);
+  if (d != NULL) {
+    list_remove(&d->lru_elem);
+    list_push_front(&lru, &d->lru_elem);
+    *sector = d->sector;
+  }
+  lock_release(&dcache_lock);
+  return d != NULL;
+}
+
+/* Returns the current generation, to be passed to a later
+   dcache_insert(). */
+unsigned dcache_generation(void) { return generation; }
+
+/* Records that NAME in PARENT is the inode in SECTOR, or that it
+   does not exist if SECTOR is DCACHE_NONE.  GEN is the
+   generation taken before the directory was read; if any entry
+   has been invalidated since, the result may be stale and is not
+   cached. */
+void dcache_insert(block_sector_t parent, const char* name, block_sector_t sector, unsigned gen) {
+  struct dentry* d;
+
+  if (strlen(name) > NAME_MAX)
+    return;
+  lock_acquire(&dcache_lock);
+  if (gen != generation || find(parent, name) != NULL) {
+    lock_release(&dcache_lock);
+    return;
+  }
+  if (hash_size(&dentries) >= DCACHE_MAX_ENTRIES)
+    discard(list_entry(list_back(&lru), struct dentry, lru_elem));
+  d = malloc(sizeof *d);
+  if (d != NULL) {
+    d->parent = parent;
+    d->sector = sector;
+    strlcpy(d->name, name, sizeof d->name);
+    hash_insert(&dentries, &d->hash_elem);
+    list_push_front(&lru, &d->lru_elem);
+  }
+  lock_release(&dcache_lock);
+}
+
+/* Drops any entry for NAME in PARENT.  Called after NAME is added
+   to or removed from the directory. */
+void dcache_invalidate(block_sector_t parent, const char* name) {
+  struct dentry* d;
+
+  lock_acquire(&dcache_lock);
+  generation++;
+  d = find(parent, name);
+  if (d != NULL)
+    discard(d);
+  lock_release(&dcache_lock);
+}
+
+/* Drops every entry in directory DIR.  Called when DIR is
+   removed, since its sector may be reused for a new directory. */
+void dcache_invalidate_dir(block_sector_t dir) {
+  struct list_elem* e;
+
+  lock_acquire(&dcache_lock);
+  generation++;
+  for (e = list_begin(&lru); e != list_end(&lru);) {
+    struct dentry* d = list_entry(e, struct dentry, lru_elem);
+    e = list_next(e);
+    if (d->parent == dir)
+      discard(d);
+  }
+  lock_release(&dcache_lock);
+}
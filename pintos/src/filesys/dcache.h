@@ -0,0 +1,21 @@
+#ifndef FILESYS_DCACHE_H
+#define FILESYS_DCACHE_H
+
+#include <stdbool.h>
+#include "devices/block.h"
+
+/* Maximum number of cached directory entries. */
+#define DCACHE_MAX_ENTRIES 256
+
+/* Sector recorded for a negative entry: NAME is known not to
+   exist in the parent directory. */
+#define DCACHE_NONE ((block_sector_t)-1)
+
+void dcache_init(void);
+bool dcache_lookup(block_sector_t parent, const char* name, block_sector_t* sector);
+unsigned dcache_generation(void);
+void dcache_insert(block_sector_t parent, const char* name, block_sector_t sector, unsigned gen);
+void dcache_invalidate(block_sector_t parent, const char* name);
+void dcache_invalidate_dir(block_sector_t dir);
+
+#endif /* filesys/dcache.h */
@@ -1,7 +1,9 @@
 #include "filesys/directory.h"
 #include <stdio.h>
 #include <string.h>
+#include <hash.h>
 #include <list.h>
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
@@ -11,6 +13,7 @@
 struct dir {
   struct inode* inode; /* Backing store. */
   off_t pos;           /* Current position. */
+  bool hashed;         /* Uses the hashed layout? */
 };
 
 /* A single directory entry. */
@@ -20,10 +23,62 @@ struct dir_entry {
   bool in_use;                 /* In use or free? */
 };
 
+/* Whether dir_create makes hashed directories.  Set by the
+   "-hashdirs" kernel command-line option. */
+bool dir_use_hash;
+
+/* A hashed directory starts with an index block, whose BUCKETS
+   give the first block of each hash chain (as a block number
+   within the directory file, 0 if the chain is empty).  Every
+   later block is an entry block on one of the chains.  The
+   layout is recorded in the directory's inode when it is created,
+   so telling the two apart needs no read. */
+#define DIR_HASH_MAGIC 0x48534944
+#define DIR_BUCKETS 126
+#define DIR_BLOCK_ENTRIES 25
+
+struct dir_index {
+  uint32_t magic;                /* DIR_HASH_MAGIC. */
+  uint32_t bucket_cnt;           /* DIR_BUCKETS. */
+  uint32_t buckets[DIR_BUCKETS]; /* First block of each chain. */
+};
+
+struct dir_block {
+  uint32_t next;                               /* Next block in chain, or 0. */
+  struct dir_entry entries[DIR_BLOCK_ENTRIES]; /* Entries. */
+  uint8_t unused[BLOCK_SECTOR_SIZE - 4 - DIR_BLOCK_ENTRIES * sizeof(struct dir_entry)];
+};
+
+/* Returns the byte offset of entry SLOT of entry block BLK. */
+static off_t slot_ofs(uint32_t blk, int slot) {
+  return blk * BLOCK_SECTOR_SIZE + offsetof(struct dir_block, entries) +
+         slot * sizeof(struct dir_entry);
+}
+
 /* Creates a directory with space for ENTRY_CNT entries in the
-   given SECTOR.  Returns true if successful, false on failure. */
+   given SECTOR.  Returns true if successful, false on failure.
+   Hashed directories ignore ENTRY_CNT and grow a block at a time. */
 bool dir_create(block_sector_t sector, size_t entry_cnt) {
-  return inode_create_dir(sector, entry_cnt * sizeof(struct dir_entry));
+  struct dir_index index;
+  struct inode* inode;
+  bool success;
+
+  if (!dir_use_hash)
+    return inode_create_dir(sector, entry_cnt * sizeof(struct dir_entry), false);
+
+  ASSERT(sizeof(struct dir_index) == BLOCK_SECTOR_SIZE);
+  ASSERT(sizeof(struct dir_block) == BLOCK_SECTOR_SIZE);
+  if (!inode_create_dir(sector, 0, true))
+    return false;
+  inode = inode_open(sector);
+  if (inode == NULL)
+    return false;
+  memset(&index, 0, sizeof index);
+  index.magic = DIR_HASH_MAGIC;
+  index.bucket_cnt = DIR_BUCKETS;
+  success = inode_write_at(inode, &index, sizeof index, 0) == sizeof index;
+  inode_close(inode);
+  return success;
 }
 
 /* Opens and returns the directory for the given INODE, of which
@@ -33,6 +88,7 @@ struct dir* dir_open(struct inode* inode) {
   if (inode != NULL && dir != NULL) {
     dir->inode = inode;
     dir->pos = 0;
+    dir->hashed = inode_is_hashed_dir(inode);
     return dir;
   } else {
     inode_close(inode);
@@ -66,6 +122,64 @@ struct inode* dir_get_inode(struct dir* dir) {
   return dir->inode;
 }
 
+/* Returns the offset of the index entry for NAME's hash chain
+   in hashed directory DIR. */
+static off_t bucket_ofs(const char* name) {
+  return offsetof(struct dir_index, buckets) + hash_string(name) % DIR_BUCKETS * sizeof(uint32_t);
+}
+
+/* lookup() for hashed directories: walks only NAME's chain. */
+static bool hashed_lookup(const struct dir* dir, const char* name, struct dir_entry* ep,
+                          off_t* ofsp) {
+  struct dir_block block;
+  uint32_t blk;
+
+  if (inode_read_at(dir->inode, &blk, sizeof blk, bucket_ofs(name)) != sizeof blk)
+    return false;
+  for (; blk != 0; blk = block.next) {
+    if (inode_read_at(dir->inode, &block, sizeof block, blk * BLOCK_SECTOR_SIZE) != sizeof block)
+      return false;
+    for (int i = 0; i < DIR_BLOCK_ENTRIES; i++) {
+      struct dir_entry* e = &block.entries[i];
+      if (e->in_use && !strcmp(name, e->name)) {
+        if (ep != NULL)
+          *ep = *e;
+        if (ofsp != NULL)
+          *ofsp = slot_ofs(blk, i);
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+/* dir_add() for hashed directories: takes the first free slot on
+   NAME's chain, or pushes a new entry block onto the front of the
+   chain if it is full.  Returns the offset for the new entry, or
+   -1 on failure. */
+static off_t hashed_add_ofs(struct dir* dir, const char* name) {
+  struct dir_block block;
+  uint32_t head, blk;
+
+  if (inode_read_at(dir->inode, &head, sizeof head, bucket_ofs(name)) != sizeof head)
+    return -1;
+  for (blk = head; blk != 0; blk = block.next) {
+    if (inode_read_at(dir->inode, &block, sizeof block, blk * BLOCK_SECTOR_SIZE) != sizeof block)
+      return -1;
+    for (int i = 0; i < DIR_BLOCK_ENTRIES; i++)
+      if (!block.entries[i].in_use)
+        return slot_ofs(blk, i);
+  }
+
+  blk = inode_length(dir->inode) / BLOCK_SECTOR_SIZE;
+  memset(&block, 0, sizeof block);
+  block.next = head;
+  if (inode_write_at(dir->inode, &block, sizeof block, blk * BLOCK_SECTOR_SIZE) != sizeof block ||
+      inode_write_at(dir->inode, &blk, sizeof blk, bucket_ofs(name)) != sizeof blk)
+    return -1;
+  return slot_ofs(blk, 0);
+}
+
 /* Searches DIR for a file with the given NAME.
    If successful, returns true, sets *EP to the directory entry
    if EP is non-null, and sets *OFSP to the byte offset of the
@@ -78,6 +192,8 @@ static bool lookup(const struct dir* dir, const char* name, struct dir_entry* ep
   ASSERT(dir != NULL);
   ASSERT(name != NULL);
 
+  if (dir->hashed)
+    return hashed_lookup(dir, name, ep, ofsp);
   for (ofs = 0; inode_read_at(dir->inode, &e, sizeof e, ofs) == sizeof e; ofs += sizeof e)
     if (e.in_use && !strcmp(name, e.name)) {
       if (ep != NULL)
@@ -92,18 +208,25 @@ static bool lookup(const struct dir* dir, const char* name, struct dir_entry* ep
 /* Searches DIR for a file with the given NAME
    and returns true if one exists, false otherwise.
    On success, sets *INODE to an inode for the file, otherwise to
-   a null pointer.  The caller must close *INODE. */
+   a null pointer.  The caller must close *INODE.
+   Answers from the dentry cache when it can, without reading the
+   directory, and caches the result of a directory read. */
 bool dir_lookup(const struct dir* dir, const char* name, struct inode** inode) {
+  block_sector_t parent, sector;
   struct dir_entry e;
 
   ASSERT(dir != NULL);
   ASSERT(name != NULL);
+  parent = inode_get_inumber(dir->inode);
   if (strcmp(name, ".") == 0) {
     *inode = inode_reopen(dir->inode);
-  } else if (lookup(dir, name, &e, NULL)) {
-    *inode = inode_open(e.inode_sector);
+  } else if (dcache_lookup(parent, name, &sector)) {
+    *inode = sector != DCACHE_NONE ? inode_open(sector) : NULL;
   } else {
-    *inode = NULL;
+    unsigned gen = dcache_generation();
+    sector = lookup(dir, name, &e, NULL) ? e.inode_sector : DCACHE_NONE;
+    dcache_insert(parent, name, sector, gen);
+    *inode = sector != DCACHE_NONE ? inode_open(sector) : NULL;
   }
   return *inode != NULL;
 }
@@ -137,15 +260,22 @@ bool dir_add(struct dir* dir, const char* name, block_sector_t inode_sector) {
      inode_read_at() will only return a short read at end of file.
      Otherwise, we'd need to verify that we didn't get a short
      read due to something intermittent such as low memory. */
-  for (ofs = 0; inode_read_at(dir->inode, &e, sizeof e, ofs) == sizeof e; ofs += sizeof e)
-    if (!e.in_use)
-      break;
+  if (dir->hashed) {
+    ofs = hashed_add_ofs(dir, name);
+    if (ofs < 0)
+      goto done;
+  } else {
+    for (ofs = 0; inode_read_at(dir->inode, &e, sizeof e, ofs) == sizeof e; ofs += sizeof e)
+      if (!e.in_use)
+        break;
+  }
 
   /* Write slot. */
   e.in_use = true;
   strlcpy(e.name, name, sizeof e.name);
   e.inode_sector = inode_sector;
   success = inode_write_at(dir->inode, &e, sizeof e, ofs) == sizeof e;
+  dcache_invalidate(inode_get_inumber(dir->inode), name);
 
 done:
   return success;
@@ -198,6 +328,9 @@ bool dir_remove(struct dir* dir, const char* name) {
   e.in_use = false;
   if (inode_write_at(dir->inode, &e, sizeof e, ofs) != sizeof e)
     goto done;
+  dcache_invalidate(inode_get_inumber(dir->inode), name);
+  if (inode_is_dir(inode))
+    dcache_invalidate_dir(inode_get_inumber(inode));
 
   /* Remove inode. */
   inode_remove(inode);
@@ -211,12 +344,18 @@ done:
 
 /* Reads the next directory entry in DIR and stores the name in
    NAME.  Returns true if successful, false if the directory
-   contains no more entries. */
+   contains no more entries.  A hashed directory is read block by
+   block in file order, skipping the index block and the chain
+   links. */
 bool dir_readdir(struct dir* dir, char name[NAME_MAX + 1]) {
   struct dir_entry e;
 
+  if (dir->hashed && dir->pos < slot_ofs(1, 0))
+    dir->pos = slot_ofs(1, 0);
   while (inode_read_at(dir->inode, &e, sizeof e, dir->pos) == sizeof e) {
     dir->pos += sizeof e;
+    if (dir->hashed && dir->pos % BLOCK_SECTOR_SIZE == slot_ofs(0, DIR_BLOCK_ENTRIES))
+      dir->pos = slot_ofs(dir->pos / BLOCK_SECTOR_SIZE + 1, 0);
     if (e.in_use && !(strcmp(e.name, "..") == 0)) {
       strlcpy(name, e.name, NAME_MAX + 1);
       return true;
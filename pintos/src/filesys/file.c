@@ -1,15 +1,25 @@
 #include "filesys/file.h"
 #include <debug.h>
 #include "filesys/inode.h"
+#include "devices/block.h"
 #include "threads/malloc.h"
 
+/* Read-ahead window bounds, in sectors. */
+#define READAHEAD_MIN 2
+#define READAHEAD_MAX 16
+
 /* An open file. */
 struct file {
   struct inode* inode; /* File's inode. */
   off_t pos;           /* Current position. */
   bool deny_write;     /* Has file_deny_write() been called? */
+  off_t ra_next;       /* Offset a sequential reader would read next. */
+  off_t ra_end;        /* End of what read-ahead has already queued. */
+  int ra_window;       /* Read-ahead window in sectors, 0 if not sequential. */
 };
 
+static void file_readahead(struct file*, off_t ofs, off_t bytes_read);
+
 /* Opens a file for the given INODE, of which it takes ownership,
    and returns the new file.  Returns a null pointer if an
    allocation fails or if INODE is null. */
@@ -19,6 +29,9 @@ struct file* file_open(struct inode* inode) {
     file->inode = inode;
     file->pos = 0;
     file->deny_write = false;
+    file->ra_next = 0;
+    file->ra_end = 0;
+    file->ra_window = 0;
     return file;
   } else {
     inode_close(inode);
@@ -54,10 +67,40 @@ struct inode* file_get_inode(struct file* file) {
    Advances FILE's position by the number of bytes read. */
 off_t file_read(struct file* file, void* buffer, off_t size) {
   off_t bytes_read = inode_read_at(file->inode, buffer, size, file->pos);
+  file_readahead(file, file->pos, bytes_read);
   file->pos += bytes_read;
   return bytes_read;
 }
 
+/* Updates FILE's sequential-access detection after BYTES_READ
+   bytes were read at offset OFS.  A read that starts where the
+   last one ended grows the read-ahead window, up to
+   READAHEAD_MAX sectors, and queues the sectors past the read
+   that are not queued yet; any other read closes the window. */
+static void file_readahead(struct file* file, off_t ofs, off_t bytes_read) {
+  off_t start, end;
+
+  if (bytes_read <= 0)
+    return;
+  if (ofs != file->ra_next) {
+    file->ra_window = 0;
+    file->ra_end = 0;
+  } else if (file->ra_window == 0)
+    file->ra_window = READAHEAD_MIN;
+  else if (file->ra_window < READAHEAD_MAX)
+    file->ra_window *= 2;
+  file->ra_next = ofs + bytes_read;
+  if (file->ra_window == 0)
+    return;
+
+  start = file->ra_next > file->ra_end ? file->ra_next : file->ra_end;
+  end = file->ra_next + file->ra_window * BLOCK_SECTOR_SIZE;
+  if (start < end) {
+    inode_readahead(file->inode, start, end - start);
+    file->ra_end = end;
+  }
+}
+
 /* Reads SIZE bytes from FILE into BUFFER,
    starting at offset FILE_OFS in the file.
    Returns the number of bytes actually read,
@@ -6,6 +6,8 @@
 #include <stdlib.h>
 #include "filesys/file.h"
 #include "filesys/free-map.h"
+#include "filesys/buffer.h"
+#include "filesys/dcache.h"
 #include "filesys/directory.h"
 #include "threads/thread.h"
 #include "threads/synch.h"
@@ -23,6 +25,7 @@ void filesys_init(bool format) {
     PANIC("No file system device found, can't initialize file system.");
 
   inode_init();
+  dcache_init();
   free_map_init();
 
   if (format)
@@ -33,7 +36,10 @@ void filesys_init(bool format) {
 
 /* Shuts down the file system module, writing any unwritten data
    to disk. */
-void filesys_done(void) { free_map_close(); }
+void filesys_done(void) {
+  free_map_close();
+  buffer_flush();
+}
 
 /* Creates a file named NAME with the given INITIAL_SIZE.
    Returns true if successful, false otherwise.
@@ -68,7 +74,7 @@ bool filesys_create_in_dir(const char* input_path, off_t initial_size) {
   return success;
 }
 
-bool filesys_create_dir_in_dir(const char* input_path, off_t initial_size) {
+bool filesys_create_dir_in_dir(const char* input_path, size_t entry_cnt) {
   block_sector_t inode_sector = 0;
   struct dir* dir = NULL;
   char* name = NULL;
@@ -84,7 +90,7 @@ bool filesys_create_dir_in_dir(const char* input_path, off_t initial_size) {
     return false;
   }
   success = (dir != NULL && free_map_allocate(1, &inode_sector) &&
-             inode_create_dir(inode_sector, initial_size) && dir_add(dir, name, inode_sector));
+             dir_create(inode_sector, entry_cnt) && dir_add(dir, name, inode_sector));
   if (!success && inode_sector != 0)
     free_map_release(inode_sector, 1);
   free(name);
@@ -19,7 +19,7 @@ bool filesys_create(const char* name, off_t initial_size);
 struct file* filesys_open(const char* name);
 bool filesys_remove(const char* name);
 bool filesys_create_in_dir(const char*, off_t);
-bool filesys_create_dir_in_dir(const char*, off_t);
+bool filesys_create_dir_in_dir(const char*, size_t entry_cnt);
 struct inode* path_to_inode(const char*);
 bool get_dir_and_name(const char*, struct dir**,
                       char**); // find file in dir given name and directory
@@ -10,6 +10,25 @@ static struct file* free_map_file; /* Free map file. */
 static struct bitmap* free_map;    /* Free map, one bit per sector. */
 static struct lock free_map_lock;
 
+/* Bits [dirty_start, dirty_end) of the free map have changed
+   since it was last written to the free map file.  Empty when
+   dirty_start >= dirty_end. */
+static size_t dirty_start, dirty_end;
+
+/* Notes that bits START through START + CNT changed.  The free
+   map lock must be held. */
+static void mark_dirty(size_t start, size_t cnt) {
+  if (dirty_start >= dirty_end) {
+    dirty_start = start;
+    dirty_end = start + cnt;
+  } else {
+    if (start < dirty_start)
+      dirty_start = start;
+    if (start + cnt > dirty_end)
+      dirty_end = start + cnt;
+  }
+}
+
 /* Initializes the free map. */
 void free_map_init(void) {
   free_map = bitmap_create(block_size(fs_device));
@@ -18,31 +37,80 @@ void free_map_init(void) {
   bitmap_mark(free_map, FREE_MAP_SECTOR);
   bitmap_mark(free_map, ROOT_DIR_SECTOR);
   lock_init(&free_map_lock);
+  lock_set_name(&free_map_lock, "free_map_lock");
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
    the first into *SECTORP.
    Returns true if successful, false if not enough consecutive
-   sectors were available or if the free_map file could not be
-   written. */
+   sectors were available. */
 bool free_map_allocate(size_t cnt, block_sector_t* sectorp) {
   bool recurse = lock_held_by_current_thread(&free_map_lock);
   if (!recurse)
     lock_acquire(&free_map_lock);
 
   block_sector_t sector = bitmap_scan_and_flip(free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR && free_map_file != NULL && !bitmap_write(free_map, free_map_file)) {
-    bitmap_set_multiple(free_map, sector, cnt, false);
-    sector = BITMAP_ERROR;
-  }
-  if (sector != BITMAP_ERROR)
+  if (sector != BITMAP_ERROR) {
+    mark_dirty(sector, cnt);
     *sectorp = sector;
+  }
 
   if (!recurse)
     lock_release(&free_map_lock);
   return sector != BITMAP_ERROR;
 }
 
+/* Allocates up to WANT consecutive sectors, preferring the first
+   run of WANT free sectors at or after GOAL, then one anywhere
+   on the disk.  If there is no run that long, takes the longest
+   free run there is.  Stores the first sector into *SECTORP and
+   returns the number allocated, or 0 if the disk is full. */
+size_t free_map_allocate_run(block_sector_t goal, size_t want, block_sector_t* sectorp) {
+  size_t bit_cnt = bitmap_size(free_map);
+  size_t best_start = 0, best_cnt = 0;
+  size_t start;
+
+  ASSERT(want > 0);
+  bool recurse = lock_held_by_current_thread(&free_map_lock);
+  if (!recurse)
+    lock_acquire(&free_map_lock);
+
+  if (goal >= bit_cnt)
+    goal = 0;
+  start = bitmap_scan(free_map, goal, want, false);
+  if (start == BITMAP_ERROR && goal > 0)
+    start = bitmap_scan(free_map, 0, want, false);
+  if (start != BITMAP_ERROR) {
+    best_start = start;
+    best_cnt = want;
+  } else {
+    // no run of WANT anywhere: settle for the longest free run
+    size_t pos = 0;
+    while (pos < bit_cnt) {
+      size_t free_start = bitmap_scan(free_map, pos, 1, false);
+      if (free_start == BITMAP_ERROR)
+        break;
+      size_t used = bitmap_scan(free_map, free_start, 1, true);
+      if (used == BITMAP_ERROR)
+        used = bit_cnt;
+      if (used - free_start > best_cnt) {
+        best_start = free_start;
+        best_cnt = used - free_start;
+      }
+      pos = used;
+    }
+  }
+  if (best_cnt > 0) {
+    bitmap_set_multiple(free_map, best_start, best_cnt, true);
+    mark_dirty(best_start, best_cnt);
+    *sectorp = best_start;
+  }
+
+  if (!recurse)
+    lock_release(&free_map_lock);
+  return best_cnt;
+}
+
 /* Makes CNT sectors starting at SECTOR available for use. */
 void free_map_release(block_sector_t sector, size_t cnt) {
   bool recurse = lock_held_by_current_thread(&free_map_lock);
@@ -50,7 +118,7 @@ void free_map_release(block_sector_t sector, size_t cnt) {
     lock_acquire(&free_map_lock);
   ASSERT(bitmap_all(free_map, sector, cnt));
   bitmap_set_multiple(free_map, sector, cnt, false);
-  bitmap_write(free_map, free_map_file);
+  mark_dirty(sector, cnt);
   if (!recurse)
     lock_release(&free_map_lock);
 }
@@ -69,12 +137,28 @@ void free_map_open(void) {
     lock_release(&free_map_lock);
 }
 
+/* Writes the changed part of the free map to the free map file.
+   Allocation and release only record what changed, so this runs
+   from the buffer cache's flusher and on close. */
+void free_map_flush(void) {
+  bool recurse = lock_held_by_current_thread(&free_map_lock);
+  if (!recurse)
+    lock_acquire(&free_map_lock);
+  if (free_map_file != NULL && dirty_start < dirty_end &&
+      bitmap_write_range(free_map, free_map_file, dirty_start, dirty_end - dirty_start))
+    dirty_start = dirty_end = 0;
+  if (!recurse)
+    lock_release(&free_map_lock);
+}
+
 /* Writes the free map to disk and closes the free map file. */
 void free_map_close(void) {
   bool recurse = lock_held_by_current_thread(&free_map_lock);
   if (!recurse)
     lock_acquire(&free_map_lock);
+  free_map_flush();
   file_close(free_map_file);
+  free_map_file = NULL;
   if (!recurse)
     lock_release(&free_map_lock);
 }
@@ -95,6 +179,7 @@ void free_map_create(void) {
     PANIC("can't open free map");
   if (!bitmap_write(free_map, free_map_file))
     PANIC("can't write free map");
+  dirty_start = dirty_end = 0;
   if (!recurse)
     lock_release(&free_map_lock);
 }
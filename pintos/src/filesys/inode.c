@@ -1,5 +1,5 @@
 #include "filesys/inode.h"
-#include <list.h>
+#include <hash.h>
 #include <debug.h>
 #include <round.h>
 #include <string.h>
@@ -9,20 +9,47 @@
 #include "threads/malloc.h"
 #include "threads/synch.h"
 
-/* Identifies an inode. */
-#define INODE_MAGIC 0x494e4f44
+/* Identifies an inode, and how its data sectors are mapped. */
+#define INODE_MAGIC 0x494e4f44        /* Per-sector direct/indirect pointers. */
+#define INODE_EXTENT_MAGIC 0x494e4f58 /* Runs of consecutive sectors. */
+
+/* Values of inode_disk's IS_DIRECTORY field.  Inode creation has
+   always written this word, unlike the one after it, so the
+   directory layout is kept here rather than in that spare word. */
+#define INODE_FILE 0       /* Regular file. */
+#define INODE_DIR 1        /* Directory with a flat array of entries. */
+#define INODE_HASHED_DIR 2 /* Directory indexed by name hash. */
+
+/* LENGTH consecutive data sectors starting at START. */
+struct extent {
+  block_sector_t start;
+  uint32_t length;
+};
+
+/* Extents held in the inode itself, and in its overflow block. */
+#define INODE_EXTENTS 61
+#define BLOCK_EXTENTS ((int)(BLOCK_SECTOR_SIZE / sizeof(struct extent)))
 
 /* On-disk inode.
    Must be exactly BLOCK_SECTOR_SIZE bytes long. */
 struct inode_disk {
   //block_sector_t start; /* First data sector. */
-  int is_directory;
-  int idklmfao;
-  off_t length;                   /* File size in bytes. */
-  unsigned magic;                 /* Magic number. */
-  block_sector_t indirect_ptr;    /* Indirect Pointer */
-  block_sector_t db_indirect_ptr; /* Doubly Indirect Pointer */
-  block_sector_t direct_ptr[122]; /* Not used. */
+  int is_directory; /* INODE_FILE, INODE_DIR or INODE_HASHED_DIR. */
+  int unused;     /* Not used; old inodes left it uninitialized. */
+  off_t length;   /* File size in bytes. */
+  unsigned magic; /* INODE_MAGIC or INODE_EXTENT_MAGIC. */
+  union {
+    struct {                          /* INODE_MAGIC. */
+      block_sector_t indirect_ptr;    /* Indirect Pointer */
+      block_sector_t db_indirect_ptr; /* Doubly Indirect Pointer */
+      block_sector_t direct_ptr[122]; /* Not used. */
+    };
+    struct {                                /* INODE_EXTENT_MAGIC. */
+      block_sector_t extent_block;          /* Extents past INODE_EXTENTS. */
+      uint32_t extent_cnt;                  /* Extents in use. */
+      struct extent extents[INODE_EXTENTS]; /* In file order. */
+    };
+  };
 };
 
 struct indirect {
@@ -32,96 +59,270 @@ struct indirect {
 bool allocate_direct(struct inode_disk*, off_t, off_t);
 bool allocate_indirect(block_sector_t*, off_t, off_t);
 bool allocate_db_indirect(block_sector_t*, off_t, off_t);
-bool expand_inode_disk(struct inode_disk*, off_t);
+bool expand_inode_disk(struct inode_disk*, off_t, block_sector_t);
 void shrink_inode_disk(struct inode_disk*, off_t);
+static void release_blocks(struct inode_disk*, off_t cur_length, off_t length);
 bool resize_inode(struct inode*, off_t);
-void set_directory(const struct inode*, bool);
 bool sanity_check(void);
 
+/* Whether inode_create uses the extent format.  Set by the
+   "-extents" kernel command-line option. */
+bool inode_use_extents;
+
+/* Returns true if DISK maps its data with extents. */
+static inline bool is_extent_format(const struct inode_disk* disk) {
+  return disk->magic == INODE_EXTENT_MAGIC;
+}
+
 /* Returns the number of sectors to allocate for an inode SIZE
    bytes long. */
 static inline size_t bytes_to_sectors(off_t size) { return DIV_ROUND_UP(size, BLOCK_SECTOR_SIZE); }
 
 /* In-memory inode. */
 struct inode {
-  struct list_elem elem; /* Element in inode list. */
+  struct hash_elem elem; /* Element in its stripe's table. */
   block_sector_t sector; /* Sector number of disk location. */
-  int open_cnt;          /* Number of openers. */
+  int open_cnt;          /* Number of openers, guarded by the stripe lock. */
   bool removed;          /* True if deleted, false otherwise. */
   int deny_write_cnt;    /* 0: writes ok, >0: deny writes. */
-  struct lock lock;      /* Protects metadata from race conditions. */
-  //struct inode_disk data; /* Inode content. */
+  struct rwlock lock;    /* Protects metadata; shared for lookups. */
+  struct inode_disk data; /* Inode content, guarded by LOCK. */
+  bool dirty;             /* DATA differs from the inode sector. */
 };
+/* Returns entry IDX of the indirect block in SECTOR. */
+static block_sector_t indirect_get(block_sector_t sector, int idx) {
+  struct buffer* b = buffer_get_shared(fs_device, sector);
+  block_sector_t rv = ((struct indirect*)b->data)->pointers[idx];
+  buffer_put(b);
+  return rv;
+}
+
+/* Sets entry IDX of the indirect block in SECTOR to VALUE.  If
+   FRESH, SECTOR was just allocated: its other entries are zeroed
+   instead of being read from disk. */
+static void indirect_set(block_sector_t sector, int idx, block_sector_t value, bool fresh) {
+  struct buffer* b = buffer_get(fs_device, sector, !fresh);
+  struct indirect* idp = (struct indirect*)b->data;
+  if (fresh)
+    memset(idp, 0, BLOCK_SECTOR_SIZE);
+  idp->pointers[idx] = value;
+  buffer_mark_dirty(b);
+  buffer_put(b);
+}
+
+/* Returns extent IDX of extent-format DISK. */
+static struct extent extent_get(const struct inode_disk* disk, int idx) {
+  struct extent e;
+  if (idx < INODE_EXTENTS)
+    return disk->extents[idx];
+  struct buffer* b = buffer_get_shared(fs_device, disk->extent_block);
+  e = ((struct extent*)b->data)[idx - INODE_EXTENTS];
+  buffer_put(b);
+  return e;
+}
+
+/* Sets extent IDX of extent-format DISK to E.  FRESH means the
+   overflow block was just allocated and need not be read. */
+static void extent_set(struct inode_disk* disk, int idx, struct extent e, bool fresh) {
+  if (idx < INODE_EXTENTS) {
+    disk->extents[idx] = e;
+    return;
+  }
+  struct buffer* b = buffer_get(fs_device, disk->extent_block, !fresh);
+  if (fresh)
+    memset(b->data, 0, BLOCK_SECTOR_SIZE);
+  ((struct extent*)b->data)[idx - INODE_EXTENTS] = e;
+  buffer_mark_dirty(b);
+  buffer_put(b);
+}
+
+/* Returns the sector holding data sector INDEX of extent-format
+   DISK, or -1 if it has no such sector. */
+static block_sector_t extent_lookup(const struct inode_disk* disk, size_t index) {
+  struct extent* ext = NULL;
+  struct buffer* b = NULL;
+  block_sector_t rv = -1;
+
+  for (int i = 0; i < (int)disk->extent_cnt; i++) {
+    if (i == INODE_EXTENTS) {
+      // walk the overflow block in place instead of pinning it per extent
+      b = buffer_get_shared(fs_device, disk->extent_block);
+      ext = (struct extent*)b->data;
+    }
+    struct extent e = i < INODE_EXTENTS ? disk->extents[i] : ext[i - INODE_EXTENTS];
+    if (index < e.length) {
+      rv = e.start + index;
+      break;
+    }
+    index -= e.length;
+  }
+  if (b != NULL)
+    buffer_put(b);
+  return rv;
+}
+
+/* Adds CNT sectors starting at START to the end of extent-format
+   DISK, growing the last extent when START follows it.  Returns
+   false if DISK has no room for another extent. */
+static bool extent_append(struct inode_disk* disk, block_sector_t start, size_t cnt) {
+  int n = disk->extent_cnt;
+  bool fresh = false;
+
+  if (n > 0) {
+    struct extent last = extent_get(disk, n - 1);
+    if (last.start + last.length == start) {
+      last.length += cnt;
+      extent_set(disk, n - 1, last, false);
+      return true;
+    }
+  }
+  if (n == INODE_EXTENTS + BLOCK_EXTENTS)
+    return false;
+  if (n == INODE_EXTENTS) {
+    if (!free_map_allocate(1, &disk->extent_block))
+      return false;
+    fresh = true;
+  }
+  extent_set(disk, n, (struct extent){start, cnt}, fresh);
+  disk->extent_cnt++;
+  return true;
+}
+
+/* Releases every data sector of extent-format DISK past the
+   first KEEP, and the overflow block once it is unused. */
+static void shrink_extents(struct inode_disk* disk, size_t keep) {
+  int old_cnt = disk->extent_cnt;
+  int new_cnt = 0;
+  size_t total = 0;
+
+  for (int i = 0; i < old_cnt; i++) {
+    struct extent e = extent_get(disk, i);
+    size_t keep_here = keep > total ? keep - total : 0;
+    total += e.length;
+    if (keep_here >= e.length) {
+      new_cnt = i + 1;
+      continue;
+    }
+    free_map_release(e.start + keep_here, e.length - keep_here);
+    if (keep_here > 0) {
+      e.length = keep_here;
+      extent_set(disk, i, e, false);
+      new_cnt = i + 1;
+    }
+  }
+  if (old_cnt > INODE_EXTENTS && new_cnt <= INODE_EXTENTS)
+    free_map_release(disk->extent_block, 1);
+  disk->extent_cnt = new_cnt;
+}
+
+/* Grows extent-format DISK, whose inode is in sector HOME, to
+   LENGTH bytes.  Each run is requested right after the previous
+   one so that it can extend the last extent. */
+static bool expand_extents(struct inode_disk* disk, off_t length, block_sector_t home) {
+  size_t have = bytes_to_sectors(disk->length);
+  size_t want = bytes_to_sectors(length);
+  block_sector_t goal = home + 1;
+
+  if (disk->extent_cnt > 0) {
+    struct extent last = extent_get(disk, disk->extent_cnt - 1);
+    goal = last.start + last.length;
+  }
+  while (have < want) {
+    block_sector_t start;
+    size_t cnt = free_map_allocate_run(goal, want - have, &start);
+
+    if (cnt == 0) {
+      shrink_extents(disk, bytes_to_sectors(disk->length));
+      return false;
+    }
+    if (!extent_append(disk, start, cnt)) {
+      free_map_release(start, cnt);
+      shrink_extents(disk, bytes_to_sectors(disk->length));
+      return false;
+    }
+    have += cnt;
+    goal = start + cnt;
+  }
+  __atomic_store_n(&disk->length, length, __ATOMIC_RELEASE);
+  return true;
+}
+
 /* Returns the block device sector that contains byte offset POS
    within INODE.
    Returns -1 if INODE does not contain data for a byte at offset
    POS. */
-static block_sector_t byte_to_sector(const struct inode* inode, off_t pos) {
+static block_sector_t byte_to_sector(struct inode* inode, off_t pos) {
   ASSERT(inode != NULL);
   int index = (int)(pos / 512);
-  struct inode_disk* disk;
-  char* buffer = malloc(sizeof(char) * 512);
-  if (buffer == NULL)
+  struct inode_disk* disk = &inode->data;
+  block_sector_t rv = -1;
+  block_sector_t ptr;
+
+  // indirect blocks are read after dropping the inode lock
+  rwlock_acquire_read(&inode->lock);
+  if (pos >= disk->length || index >= (int)(8388608 / 512)) {
+    rwlock_release(&inode->lock);
     return -1;
-
-  block_sector_t rv;
-  buffer_read(fs_device, inode->sector, (void*)buffer);
-  disk = (struct inode_disk*)buffer;
-  if (index >= disk->length || index >= 8388608) {
-    rv = -1;
   }
-  if (0 <= index && index < 122) {
+  if (is_extent_format(disk)) {
+    rv = extent_lookup(disk, index);
+    rwlock_release(&inode->lock);
+  } else if (index < 122) {
     rv = disk->direct_ptr[index];
+    rwlock_release(&inode->lock);
+  } else if (index < 122 + 128) {
+    ptr = disk->indirect_ptr;
+    rwlock_release(&inode->lock);
+    rv = indirect_get(ptr, index - 122);
+  } else {
+    ptr = disk->db_indirect_ptr;
+    rwlock_release(&inode->lock);
+    ptr = indirect_get(ptr, (index - 122 - 128) / 128);
+    rv = indirect_get(ptr, (index - 122 - 128) % 128);
   }
-  if (122 <= index && index < 122 + 128) {
-    struct indirect* idp;
-    char* buffer_idp = malloc(sizeof(char) * 512);
-    if (buffer_idp == NULL) {
-      rv = -1;
-    } else {
-      buffer_read(fs_device, disk->indirect_ptr, (void*)buffer_idp); //fs_device???
-      idp = (struct indirect*)buffer_idp;
-      rv = idp->pointers[index - 122];
-      free(buffer_idp);
-    }
-  }
-  if (122 + 128 <= index && index < (int)(8388608 / 512)) {
-    struct indirect *idp1, *idp2;
-    char* buffer_idp1 = malloc(sizeof(char) * 512);
-    char* buffer_idp2 = malloc(sizeof(char) * 512);
-    if (buffer_idp1 == NULL || buffer_idp2 == NULL) {
-      rv = -1;
-      if (buffer_idp1 != NULL)
-        free(buffer_idp1);
-      if (buffer_idp2 != NULL)
-        free(buffer_idp2);
-    } else {
-      buffer_read(fs_device, disk->db_indirect_ptr, (void*)buffer_idp1); //fs_device???
-      idp1 = (struct indirect*)buffer_idp1;
-      buffer_read(fs_device, idp1->pointers[(int)((index - 122 - 128) / 128)],
-                  (void*)buffer_idp2); //fs_device???
-      idp2 = (struct indirect*)buffer_idp2;
-      rv = idp2->pointers[(index - 122 - 128) % 128];
-      free(buffer_idp1);
-      free(buffer_idp2);
-    }
-  }
-  free(buffer);
   return rv;
 }
 
-/* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
-static struct list open_inodes;
-static struct lock open_inodes_lock;
-static struct lock open_lock;
+/* Table of open inodes, so that opening a single inode twice
+   returns the same `struct inode'.  It is split by sector into
+   stripes, each with its own lock, so that opening and closing
+   unrelated inodes does not serialize on one lock.  A stripe's
+   lock guards its table and the OPEN_CNT of its inodes. */
+#define INODE_STRIPE_BITS 4
+#define INODE_STRIPES (1 << INODE_STRIPE_BITS)
+
+struct inode_stripe {
+  struct hash inodes; /* Open inodes, keyed by sector. */
+  struct lock lock;   /* Guards INODES. */
+};
+
+static struct inode_stripe stripes[INODE_STRIPES];
+
+static unsigned inode_hash(const struct hash_elem* e, void* aux UNUSED) {
+  return hash_int(hash_entry(e, struct inode, elem)->sector);
+}
+
+static bool inode_less(const struct hash_elem* a, const struct hash_elem* b, void* aux UNUSED) {
+  return hash_entry(a, struct inode, elem)->sector < hash_entry(b, struct inode, elem)->sector;
+}
+
+/* Returns the stripe that holds the inode in SECTOR.  The stripe
+   comes from the top bits of the hash, because the table inside
+   the stripe picks its bucket from the bottom bits: using those
+   here too would crowd each stripe's inodes into a few buckets. */
+static struct inode_stripe* sector_stripe(block_sector_t sector) {
+  return &stripes[hash_int(sector) >> (32 - INODE_STRIPE_BITS)];
+}
 
 /* Initializes the inode module. */
 void inode_init(void) {
-  list_init(&open_inodes);
+  for (int i = 0; i < INODE_STRIPES; i++) {
+    if (!hash_init(&stripes[i].inodes, inode_hash, inode_less, NULL))
+      PANIC("inode table: out of memory");
+    lock_init(&stripes[i].lock);
+    lock_set_name(&stripes[i].lock, "open_inodes");
+  }
   buffer_init();
-  lock_init(&open_lock);
-  lock_init(&open_inodes_lock);
 }
 
 bool sanity_check() {
@@ -138,161 +339,155 @@ bool sanity_check() {
   return true;
 }
 
-bool expand_inode_disk(struct inode_disk* disk, off_t length) {
-  int original_length = disk->length;
+/* Allocates a sector at or after *GOAL into *SECTORP and moves
+   *GOAL past it, so that consecutive file blocks stay together. */
+static bool allocate_near(block_sector_t* goal, block_sector_t* sectorp) {
+  if (free_map_allocate_run(*goal, 1, sectorp) == 0)
+    return false;
+  *goal = *sectorp + 1;
+  return true;
+}
+
+/* Grows DISK, whose inode is in sector HOME, to LENGTH bytes.
+   DISK may be an open inode's cached copy, whose length is read
+   without its lock, so the length only changes once, at the end:
+   progress is tracked in CUR_LENGTH instead. */
+bool expand_inode_disk(struct inode_disk* disk, off_t length, block_sector_t home) {
+  if (is_extent_format(disk))
+    return expand_extents(disk, length, home);
+
+  off_t original_length = disk->length;
+  off_t cur_length = original_length;
   int index = (int)(disk->length / 512);
   if (disk->length % 512 != 0)
     index++;
-  int last = (int)(length / 512);
-  char* buffer_idp1 = malloc(sizeof(char) * 512);
-  char* buffer_idp2 = malloc(sizeof(char) * 512);
-  struct indirect *idp1, *idp2;
+  int last = (int)bytes_to_sectors(length) - 1;
+  block_sector_t idp2, sector;
+  block_sector_t goal = (0 < index && index <= 122) ? disk->direct_ptr[index - 1] + 1 : home + 1;
   bool success = true;
   while (index <= last) {
-    if (index >= 8388608) {
-      free(buffer_idp1);
-      free(buffer_idp2);
+    if (index >= 8388608)
       return false;
-    }
     if (0 <= index && index < 122) {
-      success = free_map_allocate(1, &disk->direct_ptr[index]);
+      success = allocate_near(&goal, &disk->direct_ptr[index]);
       if (!success) {
-        shrink_inode_disk(disk, original_length);
-        free(buffer_idp1);
-        free(buffer_idp2);
+        release_blocks(disk, cur_length, original_length);
         return false;
       }
     }
     if (122 <= index && index < 122 + 128) {
       if (index == 122) { //first time here so must allocate indirect struct
-        success = free_map_allocate(1, &disk->indirect_ptr);
+        success = allocate_near(&goal, &disk->indirect_ptr);
       }
       if (!success) {
-        shrink_inode_disk(disk, original_length);
-        free(buffer_idp1);
-        free(buffer_idp2);
+        release_blocks(disk, cur_length, original_length);
         return false;
       }
-      buffer_read(fs_device, disk->indirect_ptr, (void*)buffer_idp1); //fs_device???
-      idp1 = (struct indirect*)buffer_idp1;
-      success = free_map_allocate(1, &idp1->pointers[index - 122]);
+      success = allocate_near(&goal, &sector);
       if (!success) {
-        free_map_release(disk->indirect_ptr, 1); //dealloc
-        shrink_inode_disk(disk, original_length);
-        free(buffer_idp1);
-        free(buffer_idp2);
+        if (index == 122)
+          free_map_release(disk->indirect_ptr, 1); //dealloc
+        release_blocks(disk, cur_length, original_length);
         return false;
       }
-      buffer_write(fs_device, disk->indirect_ptr, (void*)buffer_idp1);
+      indirect_set(disk->indirect_ptr, index - 122, sector, index == 122);
     }
     if (122 + 128 <= index && index < (int)(8388608 / 512)) {
       if (index == 122 + 128) {
-        success = free_map_allocate(1, &disk->db_indirect_ptr);
+        success = allocate_near(&goal, &disk->db_indirect_ptr);
       }
       if (!success) {
-        shrink_inode_disk(disk, original_length);
-        free(buffer_idp1);
-        free(buffer_idp2);
+        release_blocks(disk, cur_length, original_length);
         return false;
       }
-      buffer_read(fs_device, disk->db_indirect_ptr, (void*)buffer_idp1); //fs_device???
-      idp1 = (struct indirect*)buffer_idp1;
       if ((index - 122 - 128) % 128 == 0) {
-        success = free_map_allocate(1, &idp1->pointers[(int)((index - 122 - 128) / 128)]);
+        success = allocate_near(&goal, &idp2);
+        if (success)
+          indirect_set(disk->db_indirect_ptr, (index - 122 - 128) / 128, idp2,
+                       index == 122 + 128);
+      } else {
+        idp2 = indirect_get(disk->db_indirect_ptr, (index - 122 - 128) / 128);
       }
       if (!success) {
-        free_map_release(disk->db_indirect_ptr, 1);
-        shrink_inode_disk(disk, original_length);
-        free(buffer_idp1);
-        free(buffer_idp2);
+        if (index == 122 + 128)
+          free_map_release(disk->db_indirect_ptr, 1);
+        release_blocks(disk, cur_length, original_length);
         return false;
       }
-      buffer_read(fs_device, idp1->pointers[(int)((index - 122 - 128) / 128)],
-                  (void*)buffer_idp2); //fs_device???
-      idp2 = (struct indirect*)buffer_idp2;
-      success = free_map_allocate(1, &idp2->pointers[(index - 122 - 128) % 128]);
+      success = allocate_near(&goal, &sector);
       if (!success) {
-        free_map_release(disk->db_indirect_ptr, 1);
-        free_map_release(idp1->pointers[(int)((index - 122 - 128) / 128)], 1);
-        shrink_inode_disk(disk, original_length);
-        free(buffer_idp1);
-        free(buffer_idp2);
+        if (index == 122 + 128)
+          free_map_release(disk->db_indirect_ptr, 1);
+        if ((index - 122 - 128) % 128 == 0)
+          free_map_release(idp2, 1);
+        release_blocks(disk, cur_length, original_length);
         return false;
       }
-      buffer_write(fs_device, idp1->pointers[(int)((index - 122 - 128) / 128)], (void*)buffer_idp2);
-      buffer_write(fs_device, disk->db_indirect_ptr, (void*)buffer_idp1);
+      indirect_set(idp2, (index - 122 - 128) % 128, sector, (index - 122 - 128) % 128 == 0);
     }
     index++;
-    disk->length += 512;
+    cur_length += 512;
   }
-  disk->length = length;
-  free(buffer_idp1);
-  free(buffer_idp2);
+  __atomic_store_n(&disk->length, length, __ATOMIC_RELEASE);
   return true;
 }
 
+/* Shrinks DISK to LENGTH bytes. */
 void shrink_inode_disk(struct inode_disk* disk, off_t length) {
-  int last = (int)(disk->length / 512) + 1;
-  int index = (int)(length / 512);
-  char* buffer_idp1 = malloc(sizeof(char) * 512);
-  char* buffer_idp2 = malloc(sizeof(char) * 512);
-  struct indirect *idp1, *idp2;
-  while (index >= last) {
+  if (is_extent_format(disk))
+    shrink_extents(disk, bytes_to_sectors(length));
+  else
+    release_blocks(disk, disk->length, length);
+  __atomic_store_n(&disk->length, length, __ATOMIC_RELEASE);
+}
+
+/* Releases the data sectors of block-format DISK between byte
+   lengths LENGTH and CUR_LENGTH, without changing DISK's length.
+   Goes from the last sector down, so that an indirect block is
+   released along with the first sector it covers, once nothing
+   else in it is in use. */
+static void release_blocks(struct inode_disk* disk, off_t cur_length, off_t length) {
+  int index = (int)bytes_to_sectors(cur_length) - 1;
+  int first = (int)bytes_to_sectors(length);
+  block_sector_t idp2;
+  while (index >= first) {
     if (0 <= index && index < 122) {
       free_map_release(disk->direct_ptr[index], 1);
     }
     if (122 <= index && index < 122 + 128) {
-      buffer_read(fs_device, disk->indirect_ptr, (void*)buffer_idp1); //fs_device???
-      idp1 = (struct indirect*)buffer_idp1;
-      free_map_release(idp1->pointers[index - 122], 1);
-      if (index == 122) { //first time here so must allocate indirect struct
+      free_map_release(indirect_get(disk->indirect_ptr, index - 122), 1);
+      if (index == 122) { //first sector it covers, so nothing else is in use
         free_map_release(disk->indirect_ptr, 1);
-      } else {
-        buffer_write(fs_device, disk->indirect_ptr, (void*)buffer_idp1);
       }
     }
     if (122 + 128 <= index && index < (int)(8388608 / 512)) {
-      buffer_read(fs_device, disk->db_indirect_ptr, (void*)buffer_idp1); //fs_device???
-      idp1 = (struct indirect*)buffer_idp1;
-      buffer_read(fs_device, idp1->pointers[(int)((index - 122 - 128) / 128)],
-                  (void*)buffer_idp2); //fs_device???
-      idp2 = (struct indirect*)buffer_idp2;
-      free_map_release(idp2->pointers[(index - 122 - 128) % 128], 1);
+      idp2 = indirect_get(disk->db_indirect_ptr, (index - 122 - 128) / 128);
+      free_map_release(indirect_get(idp2, (index - 122 - 128) % 128), 1);
       if ((index - 122 - 128) % 128 == 0) {
-        free_map_release(idp1->pointers[(int)((index - 122 - 128) / 128)], 1);
-      } else {
-        buffer_write(fs_device, idp1->pointers[(int)((index - 122 - 128) / 128)],
-                     (void*)buffer_idp2);
+        free_map_release(idp2, 1);
       }
       if (index == 122 + 128) {
         free_map_release(disk->db_indirect_ptr, 1);
-      } else {
-        buffer_write(fs_device, disk->db_indirect_ptr, (void*)buffer_idp1);
       }
     }
     index--;
-    disk->length -= 512;
   }
-  free(buffer_idp1);
-  free(buffer_idp2);
-  disk->length = length;
 }
 
+/* Grows or shrinks INODE to NEW_LENGTH bytes.  The caller must
+   hold INODE's lock for writing. */
 bool resize_inode(struct inode* inode, off_t new_length) {
-  char* buffer = malloc(sizeof(char) * 512);
   bool success = true;
-  buffer_read(fs_device, inode->sector, buffer);
-  struct inode_disk* disk = (struct inode_disk*)buffer;
+  struct inode_disk* disk = &inode->data;
+  ASSERT(rwlock_held_by_current_thread(&inode->lock));
   if (new_length > disk->length) {
-    success = expand_inode_disk(disk, new_length);
-    if (success) {
-      buffer_write(fs_device, inode->sector, buffer);
-    }
+    success = expand_inode_disk(disk, new_length, inode->sector);
+    if (success)
+      inode->dirty = true;
   } else if (new_length < disk->length) {
     shrink_inode_disk(disk, new_length);
-    buffer_write(fs_device, inode->sector, buffer);
+    inode->dirty = true;
   }
-  free(buffer);
   return success;
 }
 
@@ -350,104 +545,97 @@ bool allocate_db_indirect(block_sector_t* ptr, off_t start, off_t length) {
   return success;
 }
 
-/* Creates a directory. calls inode_create and sets the is_directory
-   in inode_disk to true. */
-bool inode_create_dir(block_sector_t sector, off_t length) {
-  bool success = inode_create(sector, length);
-  struct inode* inode = malloc(sizeof(struct inode));
-  inode->sector = sector;
-  if (success)
-    set_directory(inode, true);
+/* Writes a new inode with LENGTH bytes of data to sector
+   SECTOR, with KIND as its IS_DIRECTORY field.  The inode is built in
+   memory and only put into the cache once its data sectors are
+   allocated, so no cache entry stays pinned while allocation
+   pins the free map and indirect blocks. */
+static bool create_inode_disk(block_sector_t sector, off_t length, int kind) {
+  struct inode_disk* disk_inode;
+  bool success = true;
+
+  ASSERT(length >= 0);
+  /* If this assertion fails, the inode structure is not exactly
+     one sector in size, and you should fix that. */
+  ASSERT(sizeof *disk_inode == BLOCK_SECTOR_SIZE);
+
+  disk_inode = calloc(1, sizeof *disk_inode);
+  if (disk_inode == NULL)
+    return false;
+  disk_inode->magic = inode_use_extents ? INODE_EXTENT_MAGIC : INODE_MAGIC;
+  disk_inode->is_directory = kind;
+  if (length > 0)
+    success = expand_inode_disk(disk_inode, length, sector);
+  if (success) // whole sector is overwritten, so the old contents are never read
+    buffer_write(fs_device, sector, disk_inode);
+  free(disk_inode);
   return success;
 }
 
+/* Creates a directory inode with LENGTH bytes of data in
+   sector SECTOR, marked as using the hashed layout if HASHED. */
+bool inode_create_dir(block_sector_t sector, off_t length, bool hashed) {
+  return create_inode_disk(sector, length, hashed ? INODE_HASHED_DIR : INODE_DIR);
+}
+
 /* Initializes an inode with LENGTH bytes of data and
    writes the new inode to sector SECTOR on the file system
    device.
    Returns true if successful.
    Returns false if memory or disk allocation fails. */
 bool inode_create(block_sector_t sector, off_t length) {
-  bool success = false;
-
-  ASSERT(length >= 0);
-  struct inode_disk* disk_inode;
-  /* If this assertion fails, the inode structure is not exactly
-     one sector in size, and you should fix that. */
-  ASSERT(sizeof *disk_inode == BLOCK_SECTOR_SIZE);
-
-  struct inode* inode = malloc(sizeof(struct inode));
-  inode->sector = sector;
-  success = resize_inode(inode, length);
-  set_directory(inode, false);
-  free(inode);
-  return success;
+  return create_inode_disk(sector, length, INODE_FILE);
 }
 
 /* Reads an inode from SECTOR
    and returns a `struct inode' that contains it.
    Returns a null pointer if memory allocation fails. */
 struct inode* inode_open(block_sector_t sector) {
-  bool recurse = lock_held_by_current_thread(&open_lock);
-  if (!recurse) {
-    lock_acquire(&open_lock);
-    lock_acquire(&open_inodes_lock);
-  }
-  struct list_elem* e;
+  struct inode_stripe* st = sector_stripe(sector);
+  struct inode key;
+  struct hash_elem* e;
   struct inode* inode;
 
+  lock_acquire(&st->lock);
+
   /* Check whether this inode is already open. */
-  for (e = list_begin(&open_inodes); e != list_end(&open_inodes); e = list_next(e)) {
-    inode = list_entry(e, struct inode, elem);
-    if (inode->sector == sector) {
-      inode_reopen(inode);
-      if (!recurse) {
-        lock_release(&open_inodes_lock);
-        lock_release(&open_lock);
-      }
-      return inode;
-    }
+  key.sector = sector;
+  e = hash_find(&st->inodes, &key.elem);
+  if (e != NULL) {
+    inode = hash_entry(e, struct inode, elem);
+    inode->open_cnt++;
+    lock_release(&st->lock);
+    return inode;
   }
-  /*if (!recurse)
-    lock_release(&open_inodes_lock);*/
 
   /* Allocate memory. */
   inode = malloc(sizeof *inode);
-  //char* buffer = malloc(sizeof(char) * 512);
   if (inode == NULL) {
-    /*if (!recurse)
-        lock_release(&inode_open_lock);*/
+    lock_release(&st->lock);
     return NULL;
   }
 
-  //free(inode);
-  /* Initialize. */
+  /* Initialize.  The stripe stays locked while the inode is
+     read, so that a concurrent open of SECTOR waits for it. */
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  lock_init(&inode->lock);
+  rwlock_init(&inode->lock);
   inode->sector = sector;
-  list_push_front(&open_inodes, &inode->elem);
-  int len = inode_length(inode);
-  if (!recurse) {
-    lock_release(&open_inodes_lock);
-    lock_release(&open_lock);
-  }
+  inode->dirty = false;
+  buffer_read(fs_device, sector, &inode->data);
+  hash_insert(&st->inodes, &inode->elem);
+  lock_release(&st->lock);
   return inode;
 }
 
 /* Reopens and returns INODE. */
 struct inode* inode_reopen(struct inode* inode) {
-  bool recurse = lock_held_by_current_thread(&open_lock);
-  if (!recurse) {
-    lock_acquire(&open_lock);
-  }
   if (inode != NULL) {
-    lock_acquire(&inode->lock);
+    struct inode_stripe* st = sector_stripe(inode->sector);
+    lock_acquire(&st->lock);
     inode->open_cnt++;
-    lock_release(&inode->lock);
-  }
-  if (!recurse) {
-    lock_release(&open_lock);
+    lock_release(&st->lock);
   }
   return inode;
 }
@@ -459,52 +647,69 @@ block_sector_t inode_get_inumber(const struct inode* inode) { return inode->sect
    If this was the last reference to INODE, frees its memory.
    If INODE was also a removed inode, frees its blocks. */
 void inode_close(struct inode* inode) {
-  /* bool recurse = lock_held_by_current_thread(&open_lock);
-  
-  
-  if (!recurse) {
-      //lock_acquire(&open_lock);
-    lock_acquire(&open_inodes_lock);
-    }*/
+  struct inode_stripe* st;
+
   if (inode == NULL)
     return;
-  lock_acquire(&inode->lock);
-  //bool recurse = lock_held_by_current_thread(&inode->lock);
-  //if (!recurse)
-  //lock_acquire(&inode->lock);
-  /* Release resources if this was the last opener. */
-  if (--inode->open_cnt == 0) {
-    /* Remove from inode list and release lock. */
-    lock_acquire(&open_inodes_lock);
-    list_remove(&inode->elem);
-    lock_release(&open_inodes_lock);
-    /* Deallocate blocks if removed. */
-    if (inode->removed) {
-      // inode_create but uno reverse
-      resize_inode(inode, 0);
-      free_map_release(inode->sector, 1);
-      //free_map_release(inode->data.start, bytes_to_sectors(inode->data.length));
+  st = sector_stripe(inode->sector);
+  lock_acquire(&st->lock);
+  if (--inode->open_cnt > 0) {
+    lock_release(&st->lock);
+    return;
+  }
+
+  /* Last opener: write the inode back before it leaves the
+     table, so that a new inode_open() cannot read a stale copy.
+     A removed inode cannot be opened again, so its blocks are
+     freed after the stripe is unlocked. */
+  if (!inode->removed && inode->dirty)
+    buffer_write(fs_device, inode->sector, &inode->data);
+  hash_delete(&st->inodes, &inode->elem);
+  lock_release(&st->lock);
+
+  if (inode->removed) {
+    // inode_create but uno reverse
+    rwlock_acquire_write(&inode->lock);
+    resize_inode(inode, 0);
+    rwlock_release(&inode->lock);
+    free_map_release(inode->sector, 1);
+  }
+  free(inode);
+}
+
+/* Copies every dirty open inode into the buffer cache, so the
+   next cache flush puts its metadata on disk.  Inodes that are
+   being modified are skipped; they are picked up next time or on
+   close.  The stripe lock keeps concurrent flushes from racing on
+   the dirty flag, so the inode lock is only needed shared. */
+void inode_flush_all(void) {
+  struct hash_iterator i;
+
+  for (int s = 0; s < INODE_STRIPES; s++) {
+    struct inode_stripe* st = &stripes[s];
+    lock_acquire(&st->lock);
+    hash_first(&i, &st->inodes);
+    while (hash_next(&i)) {
+      struct inode* inode = hash_entry(hash_cur(&i), struct inode, elem);
+      if (!rwlock_try_acquire_read(&inode->lock))
+        continue;
+      if (inode->dirty && !inode->removed) {
+        buffer_write(fs_device, inode->sector, &inode->data);
+        inode->dirty = false;
+      }
+      rwlock_release(&inode->lock);
     }
-    //buffer_evict(inode->sector);
-    int len = inode_length(inode);
-    free(inode);
-  } else {
-    lock_release(&inode->lock);
+    lock_release(&st->lock);
   }
-  /*
-  if (!recurse) {
-      lock_release(&open_inodes_lock);
-      lock_release(&open_lock);
-      }*/
 }
 
 /* Marks INODE to be deleted when it is closed by the last caller who
    has it open. */
 void inode_remove(struct inode* inode) {
   ASSERT(inode != NULL);
-  lock_acquire(&inode->lock);
+  rwlock_acquire_write(&inode->lock);
   inode->removed = true;
-  lock_release(&inode->lock);
+  rwlock_release(&inode->lock);
 }
 
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
@@ -513,10 +718,7 @@ void inode_remove(struct inode* inode) {
 off_t inode_read_at(struct inode* inode, void* buffer_, off_t size, off_t offset) {
   uint8_t* buffer = buffer_;
   off_t bytes_read = 0;
-  char* temp = malloc(sizeof(char) * 512);
-  if (temp == NULL)
-    return 0;
-  // uint8_t* bounce = NULL;
+  struct buffer* b;
 
   while (size > 0) {
     /* Disk sector to read, starting byte offset within sector. */
@@ -533,19 +735,36 @@ off_t inode_read_at(struct inode* inode, void* buffer_, off_t size, off_t offset
     if (chunk_size <= 0)
       break;
 
-    buffer_read(fs_device, sector_idx, (void*)temp);
-    memcpy(buffer + bytes_read, (void*)(temp + sector_ofs), chunk_size);
+    b = buffer_get_shared(fs_device, sector_idx);
+    memcpy(buffer + bytes_read, b->data + sector_ofs, chunk_size);
+    buffer_put(b);
 
     /* Advance. */
     size -= chunk_size;
     offset += chunk_size;
     bytes_read += chunk_size;
   }
-  // free(bounce);
-  free(temp);
   return bytes_read;
 }
 
+/* Queues the data sectors holding bytes OFFSET through
+   OFFSET + LENGTH of INODE for asynchronous read-ahead, resolving
+   them through the direct and indirect pointers.  Stops at end of
+   file. */
+void inode_readahead(struct inode* inode, off_t offset, off_t length) {
+  off_t end = offset + length;
+  off_t inode_len = inode_length(inode);
+
+  if (end > inode_len)
+    end = inode_len;
+  for (offset = ROUND_DOWN(offset, BLOCK_SECTOR_SIZE); offset < end; offset += BLOCK_SECTOR_SIZE) {
+    block_sector_t sector_idx = byte_to_sector(inode, offset);
+    if (sector_idx == (block_sector_t)-1)
+      break;
+    buffer_prefetch(sector_idx);
+  }
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
    less than SIZE if end of file is reached or an error occurs.
@@ -555,15 +774,16 @@ off_t inode_write_at(struct inode* inode, const void* buffer_, off_t size, off_t
   const uint8_t* buffer = buffer_;
   off_t bytes_written = 0;
   bool success = true;
-  char* temp = malloc(sizeof(char) * 512);
-  if (temp == NULL)
-    return 0;
-  // uint8_t* bounce = NULL;
+  struct buffer* b;
 
   if (inode->deny_write_cnt)
     return 0;
+  // only a write past end of file needs the inode lock exclusively
   if (inode_length(inode) < offset + size) {
-    success = resize_inode(inode, size + offset);
+    rwlock_acquire_write(&inode->lock);
+    if (inode->data.length < offset + size)
+      success = resize_inode(inode, size + offset);
+    rwlock_release(&inode->lock);
     if (!success)
       return 0;
   }
@@ -582,30 +802,26 @@ off_t inode_write_at(struct inode* inode, const void* buffer_, off_t size, off_t
     int chunk_size = size < min_left ? size : min_left;
     if (chunk_size <= 0)
       break;
-    if (sector_ofs > 0 || chunk_size < sector_left)
-      buffer_read(fs_device, sector_idx, (void*)temp);
-    else
-      memset(temp, 0, BLOCK_SECTOR_SIZE);
-
-    memcpy((void*)temp + sector_ofs, buffer + bytes_written, chunk_size);
-    buffer_write(fs_device, sector_idx, (void*)temp);
+    // a write covering the whole sector needn't read it first
+    b = buffer_get(fs_device, sector_idx, sector_ofs > 0 || chunk_size < sector_left);
+    memcpy(b->data + sector_ofs, buffer + bytes_written, chunk_size);
+    buffer_mark_dirty(b);
+    buffer_put(b);
 
     /* Advance. */
     size -= chunk_size;
     offset += chunk_size;
     bytes_written += chunk_size;
   }
-  // free(bounce);
-  free(temp);
   return bytes_written;
 }
 
 /* Disables writes to INODE.
    May be called at most once per inode opener. */
 void inode_deny_write(struct inode* inode) {
-  lock_acquire(&inode->lock);
+  rwlock_acquire_write(&inode->lock);
   inode->deny_write_cnt++;
-  lock_release(&inode->lock);
+  rwlock_release(&inode->lock);
   ASSERT(inode->deny_write_cnt <= inode->open_cnt);
 }
 
@@ -615,32 +831,26 @@ void inode_deny_write(struct inode* inode) {
 void inode_allow_write(struct inode* inode) {
   ASSERT(inode->deny_write_cnt > 0);
   ASSERT(inode->deny_write_cnt <= inode->open_cnt);
-  lock_acquire(&inode->lock);
+  rwlock_acquire_write(&inode->lock);
   inode->deny_write_cnt--;
-  lock_release(&inode->lock);
+  rwlock_release(&inode->lock);
 }
 
-/* Returns the length, in bytes, of INODE's data. */
+/* Returns the length, in bytes, of INODE's data.  Read without
+   taking INODE's lock: resizing stores the length once, when it
+   is final, after the sectors it covers are in place. */
 off_t inode_length(const struct inode* inode) {
-  char buffer[512];
-  buffer_read(fs_device, inode->sector, (void*)buffer);
-  struct inode_disk* id = (struct inode_disk*)buffer;
-  return id->length;
+  return __atomic_load_n(&inode->data.length, __ATOMIC_ACQUIRE);
 }
 
-void set_directory(const struct inode* inode, bool isdir) {
-  char buffer[512];
-  buffer_read(fs_device, inode->sector, (void*)buffer);
-  struct inode_disk* id = (struct inode_disk*)buffer;
-  id->is_directory = isdir;
-  buffer_write(fs_device, inode->sector, (void*)buffer);
+bool inode_is_dir(const struct inode* inode) {
+  return inode->data.is_directory == INODE_DIR || inode->data.is_directory == INODE_HASHED_DIR;
 }
 
-bool inode_is_dir(const struct inode* inode) {
-  char buffer[512];
-  buffer_read(fs_device, inode->sector, (void*)buffer);
-  struct inode_disk* id = (struct inode_disk*)buffer;
-  return id->is_directory == 1;
+/* Returns true if INODE is a directory with the hashed layout.
+   Reads the cached inode, so it does no I/O. */
+bool inode_is_hashed_dir(const struct inode* inode) {
+  return inode->data.is_directory == INODE_HASHED_DIR;
 }
 
 int inode_open_cnt(const struct inode* inode) { return inode->open_cnt; }
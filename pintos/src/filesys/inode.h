@@ -7,20 +7,25 @@
 
 struct bitmap;
 
+extern bool inode_use_extents;
+
 void inode_init(void);
 bool inode_create(block_sector_t, off_t);
-bool inode_create_dir(block_sector_t, off_t);
+bool inode_create_dir(block_sector_t, off_t, bool hashed);
 struct inode* inode_open(block_sector_t);
 struct inode* inode_reopen(struct inode*);
 block_sector_t inode_get_inumber(const struct inode*);
 void inode_close(struct inode*);
 void inode_remove(struct inode*);
+void inode_flush_all(void);
 off_t inode_read_at(struct inode*, void*, off_t size, off_t offset);
 off_t inode_write_at(struct inode*, const void*, off_t size, off_t offset);
+void inode_readahead(struct inode*, off_t offset, off_t length);
 void inode_deny_write(struct inode*);
 void inode_allow_write(struct inode*);
 off_t inode_length(const struct inode*);
 bool inode_is_dir(const struct inode*);
+bool inode_is_hashed_dir(const struct inode*);
 int inode_open_cnt(const struct inode*);
 bool inode_removed(const struct inode*);
 #endif /* filesys/inode.h */
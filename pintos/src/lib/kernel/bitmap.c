@@ -3,6 +3,8 @@
 #include <limits.h>
 #include <round.h>
 #include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
 #ifdef FILESYS
 #include "filesys/file.h"
@@ -23,10 +25,18 @@ typedef unsigned long elem_type;
 
 /* From the outside, a bitmap is an array of bits.  From the
    inside, it's an array of elem_type (defined above) that
-   simulates an array of bits. */
+   simulates an array of bits.
+
+   Two summary arrays, with one bit per element of BITS, let
+   scans skip runs of elements that cannot contain a match
+   without looking at them: bit I of FULL is set if every bit of
+   BITS[I] is set, and bit I of NONZERO is set if any bit of
+   BITS[I] is set.  They are stored right after BITS. */
 struct bitmap {
-  size_t bit_cnt;  /* Number of bits. */
-  elem_type* bits; /* Elements that represent bits. */
+  size_t bit_cnt;     /* Number of bits. */
+  elem_type* bits;    /* Elements that represent bits. */
+  elem_type* full;    /* Elements of BITS that are all ones. */
+  elem_type* nonzero; /* Elements of BITS that are not all zeros. */
 };
 
 /* Returns the index of the element that contains the bit
@@ -50,6 +60,99 @@ static inline elem_type last_mask(const struct bitmap* b) {
   return last_bits ? ((elem_type)1 << last_bits) - 1 : (elem_type)-1;
 }
 
+/* Returns the number of elements in each summary array for a
+   bitmap of BIT_CNT bits. */
+static inline size_t summary_cnt(size_t bit_cnt) { return elem_cnt(elem_cnt(bit_cnt)); }
+
+/* Returns the number of bytes required for BIT_CNT bits and their
+   summaries. */
+static inline size_t storage_cnt(size_t bit_cnt) {
+  return byte_cnt(bit_cnt) + 2 * sizeof(elem_type) * summary_cnt(bit_cnt);
+}
+
+/* Points B's summary arrays into the storage after B's bits and
+   clears them. */
+static void summary_init(struct bitmap* b) {
+  b->full = b->bits + elem_cnt(b->bit_cnt);
+  b->nonzero = b->full + summary_cnt(b->bit_cnt);
+  memset(b->full, 0, 2 * sizeof(elem_type) * summary_cnt(b->bit_cnt));
+}
+
+/* Brings the summary bits for element IDX of B up to date.
+   Interrupts must be off, so that the element and its summary
+   bits change together. */
+static void summary_update(struct bitmap* b, size_t idx) {
+  elem_type used = idx == elem_cnt(b->bit_cnt) - 1 ? last_mask(b) : (elem_type)-1;
+  elem_type word = b->bits[idx];
+  size_t sum_idx = elem_idx(idx);
+  elem_type mask = bit_mask(idx);
+
+  ASSERT(intr_get_level() == INTR_OFF);
+  if (word == used)
+    b->full[sum_idx] |= mask;
+  else
+    b->full[sum_idx] &= ~mask;
+  if (word != 0)
+    b->nonzero[sum_idx] |= mask;
+  else
+    b->nonzero[sum_idx] &= ~mask;
+}
+
+/* Returns an elem_type with bits OFS through OFS + CNT - 1 set. */
+static inline elem_type range_mask(size_t ofs, size_t cnt) {
+  elem_type mask = cnt < ELEM_BITS ? ((elem_type)1 << cnt) - 1 : (elem_type)-1;
+  return mask << ofs;
+}
+
+/* Returns the number of bits set in W. */
+static inline size_t popcount(elem_type w) {
+  size_t cnt = 0;
+  for (; w != 0; w &= w - 1)
+    cnt++;
+  return cnt;
+}
+
+/* Returns the index of the first element of B at or after IDX
+   that has a bit set to VALUE, or elem_cnt(B->bit_cnt) if there
+   is none.  Consults only the summary arrays. */
+static size_t next_elem(const struct bitmap* b, size_t idx, bool value) {
+  size_t cnt = elem_cnt(b->bit_cnt);
+  const elem_type* sum = value ? b->nonzero : b->full;
+  size_t sum_idx = elem_idx(idx);
+  elem_type w;
+
+  if (idx >= cnt)
+    return cnt;
+  w = (value ? sum[sum_idx] : ~sum[sum_idx]) & ~(bit_mask(idx) - 1);
+  while (w == 0) {
+    if (++sum_idx >= summary_cnt(b->bit_cnt))
+      return cnt;
+    w = value ? sum[sum_idx] : ~sum[sum_idx];
+  }
+  idx = sum_idx * ELEM_BITS + __builtin_ctzl(w);
+  return idx < cnt ? idx : cnt;
+}
+
+/* Returns the index of the first bit in B at or after START that
+   is set to VALUE, or B->bit_cnt if there is none. */
+static size_t next_bit(const struct bitmap* b, size_t start, bool value) {
+  size_t idx = elem_idx(start);
+  elem_type w;
+  size_t bit;
+
+  if (start >= b->bit_cnt)
+    return b->bit_cnt;
+  w = (value ? b->bits[idx] : ~b->bits[idx]) & ~(bit_mask(start) - 1);
+  while (w == 0) {
+    idx = next_elem(b, idx + 1, value);
+    if (idx >= elem_cnt(b->bit_cnt))
+      return b->bit_cnt;
+    w = value ? b->bits[idx] : ~b->bits[idx];
+  }
+  bit = idx * ELEM_BITS + __builtin_ctzl(w);
+  return bit < b->bit_cnt ? bit : b->bit_cnt;
+}
+
 /* Creation and destruction. */
 
 /* Creates and returns a pointer to a newly allocated bitmap with room for
@@ -60,8 +163,9 @@ struct bitmap* bitmap_create(size_t bit_cnt) {
   struct bitmap* b = malloc(sizeof *b);
   if (b != NULL) {
     b->bit_cnt = bit_cnt;
-    b->bits = malloc(byte_cnt(bit_cnt));
+    b->bits = malloc(storage_cnt(bit_cnt));
     if (b->bits != NULL || bit_cnt == 0) {
+      summary_init(b);
       bitmap_set_all(b, false);
       return b;
     }
@@ -80,13 +184,14 @@ struct bitmap* bitmap_create_in_buf(size_t bit_cnt, void* block, size_t block_si
 
   b->bit_cnt = bit_cnt;
   b->bits = (elem_type*)(b + 1);
+  summary_init(b);
   bitmap_set_all(b, false);
   return b;
 }
 
 /* Returns the number of bytes required to accomodate a bitmap
    with BIT_CNT bits (for use with bitmap_create_in_buf()). */
-size_t bitmap_buf_size(size_t bit_cnt) { return sizeof(struct bitmap) + byte_cnt(bit_cnt); }
+size_t bitmap_buf_size(size_t bit_cnt) { return sizeof(struct bitmap) + storage_cnt(bit_cnt); }
 
 /* Destroys bitmap B, freeing its storage.
    Not for use on bitmaps created by bitmap_create_in_buf(). */
@@ -121,8 +226,13 @@ void bitmap_mark(struct bitmap* b, size_t bit_idx) {
 
   /* This is equivalent to `b->bits[idx] |= mask' except that it
      is guaranteed to be atomic on a uniprocessor machine.  See
-     the description of the OR instruction in [IA32-v2b]. */
+     the description of the OR instruction in [IA32-v2b].
+     Interrupts are still turned off so that the summary bits
+     change along with the element. */
+  enum intr_level old_level = intr_disable();
   asm("orl %1, %0" : "=m"(b->bits[idx]) : "r"(mask) : "cc");
+  summary_update(b, idx);
+  intr_set_level(old_level);
 }
 
 /* Atomically sets the bit numbered BIT_IDX in B to false. */
@@ -132,8 +242,12 @@ void bitmap_reset(struct bitmap* b, size_t bit_idx) {
 
   /* This is equivalent to `b->bits[idx] &= ~mask' except that it
      is guaranteed to be atomic on a uniprocessor machine.  See
-     the description of the AND instruction in [IA32-v2a]. */
+     the description of the AND instruction in [IA32-v2a].  The
+     summary bits are updated along with it, as above. */
+  enum intr_level old_level = intr_disable();
   asm("andl %1, %0" : "=m"(b->bits[idx]) : "r"(~mask) : "cc");
+  summary_update(b, idx);
+  intr_set_level(old_level);
 }
 
 /* Atomically toggles the bit numbered IDX in B;
@@ -145,8 +259,12 @@ void bitmap_flip(struct bitmap* b, size_t bit_idx) {
 
   /* This is equivalent to `b->bits[idx] ^= mask' except that it
      is guaranteed to be atomic on a uniprocessor machine.  See
-     the description of the XOR instruction in [IA32-v2b]. */
+     the description of the XOR instruction in [IA32-v2b].  The
+     summary bits are updated along with it, as above. */
+  enum intr_level old_level = intr_disable();
   asm("xorl %1, %0" : "=m"(b->bits[idx]) : "r"(mask) : "cc");
+  summary_update(b, idx);
+  intr_set_level(old_level);
 }
 
 /* Returns the value of the bit numbered IDX in B. */
@@ -165,47 +283,62 @@ void bitmap_set_all(struct bitmap* b, bool value) {
   bitmap_set_multiple(b, 0, bitmap_size(b), value);
 }
 
-/* Sets the CNT bits starting at START in B to VALUE. */
+/* Sets the CNT bits starting at START in B to VALUE, a whole
+   element at a time where possible.  Atomic, since interrupts
+   are turned off throughout. */
 void bitmap_set_multiple(struct bitmap* b, size_t start, size_t cnt, bool value) {
-  size_t i;
+  enum intr_level old_level;
 
   ASSERT(b != NULL);
   ASSERT(start <= b->bit_cnt);
   ASSERT(start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    bitmap_set(b, start + i, value);
+  old_level = intr_disable();
+  while (cnt > 0) {
+    size_t idx = elem_idx(start);
+    size_t ofs = start % ELEM_BITS;
+    size_t n = ELEM_BITS - ofs < cnt ? ELEM_BITS - ofs : cnt;
+    elem_type mask = range_mask(ofs, n);
+
+    if (value)
+      b->bits[idx] |= mask;
+    else
+      b->bits[idx] &= ~mask;
+    summary_update(b, idx);
+    start += n;
+    cnt -= n;
+  }
+  intr_set_level(old_level);
 }
 
 /* Returns the number of bits in B between START and START + CNT,
    exclusive, that are set to VALUE. */
 size_t bitmap_count(const struct bitmap* b, size_t start, size_t cnt, bool value) {
-  size_t i, value_cnt;
+  size_t one_cnt, total = cnt;
 
   ASSERT(b != NULL);
   ASSERT(start <= b->bit_cnt);
   ASSERT(start + cnt <= b->bit_cnt);
 
-  value_cnt = 0;
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test(b, start + i) == value)
-      value_cnt++;
-  return value_cnt;
+  one_cnt = 0;
+  while (cnt > 0) {
+    size_t ofs = start % ELEM_BITS;
+    size_t n = ELEM_BITS - ofs < cnt ? ELEM_BITS - ofs : cnt;
+    one_cnt += popcount(b->bits[elem_idx(start)] & range_mask(ofs, n));
+    start += n;
+    cnt -= n;
+  }
+  return value ? one_cnt : total - one_cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
    exclusive, are set to VALUE, and false otherwise. */
 bool bitmap_contains(const struct bitmap* b, size_t start, size_t cnt, bool value) {
-  size_t i;
-
   ASSERT(b != NULL);
   ASSERT(start <= b->bit_cnt);
   ASSERT(start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test(b, start + i) == value)
-      return true;
-  return false;
+  return cnt > 0 && next_bit(b, start, value) < start + cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -231,17 +364,26 @@ bool bitmap_all(const struct bitmap* b, size_t start, size_t cnt) {
 /* Finds and returns the starting index of the first group of CNT
    consecutive bits in B at or after START that are all set to
    VALUE.
-   If there is no such group, returns BITMAP_ERROR. */
+   If there is no such group, returns BITMAP_ERROR.
+   Hops from one run of VALUE bits to the next, skipping whole
+   elements, and whole groups of elements via the summaries, that
+   contain no bit set to VALUE. */
 size_t bitmap_scan(const struct bitmap* b, size_t start, size_t cnt, bool value) {
   ASSERT(b != NULL);
   ASSERT(start <= b->bit_cnt);
 
-  if (cnt <= b->bit_cnt) {
-    size_t last = b->bit_cnt - cnt;
-    size_t i;
-    for (i = start; i <= last; i++)
-      if (!bitmap_contains(b, i, cnt, !value))
-        return i;
+  if (cnt == 0)
+    return start;
+  while (cnt <= b->bit_cnt - start) {
+    size_t run_start = next_bit(b, start, value);
+    size_t run_end;
+
+    if (cnt > b->bit_cnt - run_start)
+      break;
+    run_end = next_bit(b, run_start, !value);
+    if (run_end - run_start >= cnt)
+      return run_start;
+    start = run_end;
   }
   return BITMAP_ERROR;
 }
@@ -274,6 +416,11 @@ bool bitmap_read(struct bitmap* b, struct file* file) {
     off_t size = byte_cnt(b->bit_cnt);
     success = file_read_at(file, b->bits, size, 0) == size;
     b->bits[elem_cnt(b->bit_cnt) - 1] &= last_mask(b);
+
+    enum intr_level old_level = intr_disable();
+    for (size_t i = 0; i < elem_cnt(b->bit_cnt); i++)
+      summary_update(b, i);
+    intr_set_level(old_level);
   }
   return success;
 }
@@ -284,6 +431,21 @@ bool bitmap_write(const struct bitmap* b, struct file* file) {
   off_t size = byte_cnt(b->bit_cnt);
   return file_write_at(file, b->bits, size, 0) == size;
 }
+
+/* Writes the part of B holding bits START through START + CNT
+   (exclusive) to the same place in FILE, rounded out to whole
+   elements.  Return true if successful, false otherwise. */
+bool bitmap_write_range(const struct bitmap* b, struct file* file, size_t start, size_t cnt) {
+  ASSERT(start <= b->bit_cnt);
+  ASSERT(cnt <= b->bit_cnt - start);
+  if (cnt == 0)
+    return true;
+
+  size_t first = elem_idx(start);
+  size_t last = elem_idx(start + cnt - 1);
+  off_t size = (last - first + 1) * sizeof(elem_type);
+  return file_write_at(file, &b->bits[first], size, first * sizeof(elem_type)) == size;
+}
 #endif /* FILESYS */
 
 /* Debugging. */
@@ -1,5 +1,6 @@
 #include <ctype.h>
 #include <debug.h>
+#include <limits.h>
 #include <random.h>
 #include <stdlib.h>
 #include <stdbool.h>
@@ -37,6 +38,72 @@ int atoi(const char* s) {
   return value;
 }
 
+/* Converts the initial part of S, an unsigned integer in the
+   given BASE, into an `unsigned long', which is returned.  BASE
+   may be 2 through 36, or 0 to accept a decimal, octal (with a
+   leading 0) or hexadecimal (with a leading 0x) number.  A
+   leading minus sign negates the result.  If the value is out of
+   range, returns ULONG_MAX.  If ENDPTR is non-null, sets *ENDPTR
+   to the first character not parsed, or to S if no digits were
+   found. */
+unsigned long strtoul(const char* s, char** endptr, int base) {
+  const char* start = s;
+  bool negative, overflow, any;
+  unsigned long value;
+
+  ASSERT(s != NULL);
+  ASSERT(base == 0 || (base >= 2 && base <= 36));
+
+  /* Skip white space. */
+  while (isspace((unsigned char)*s))
+    s++;
+
+  /* Parse sign. */
+  negative = false;
+  if (*s == '+')
+    s++;
+  else if (*s == '-') {
+    negative = true;
+    s++;
+  }
+
+  /* Parse base prefix. */
+  if ((base == 0 || base == 16) && s[0] == '0' && tolower((unsigned char)s[1]) == 'x' &&
+      isxdigit((unsigned char)s[2])) {
+    s += 2;
+    base = 16;
+  } else if (base == 0)
+    base = s[0] == '0' ? 8 : 10;
+
+  /* Parse digits. */
+  overflow = any = false;
+  for (value = 0;; s++) {
+    int c = tolower((unsigned char)*s);
+    int digit;
+
+    if (isdigit(c))
+      digit = c - '0';
+    else if (c >= 'a' && c <= 'z')
+      digit = c - 'a' + 10;
+    else
+      break;
+    if (digit >= base)
+      break;
+
+    any = true;
+    if (value > (ULONG_MAX - digit) / base)
+      overflow = true;
+    else
+      value = value * base + digit;
+  }
+
+  if (endptr != NULL)
+    *endptr = (char*)(any ? s : start);
+  if (overflow)
+    return ULONG_MAX;
+  return negative ? -value : value;
+}
+
 /* Compares A and B by calling the AUX function. */
 static int compare_thunk(const void* a, const void* b, void* aux) {
   int (**compare)(const void*, const void*) = aux;
@@ -5,6 +5,7 @@
 
 /* Standard functions. */
 int atoi(const char*);
+unsigned long strtoul(const char*, char** endptr, int base);
 void qsort(void* array, size_t cnt, size_t size, int (*compare)(const void*, const void*));
 void* bsearch(const void* key, const void* array, size_t cnt, size_t size,
               int (*compare)(const void*, const void*));
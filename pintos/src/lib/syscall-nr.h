@@ -28,7 +28,12 @@ enum {
   SYS_MKDIR,   /* Create a directory. */
   SYS_READDIR, /* Reads a directory entry. */
   SYS_ISDIR,   /* Tests if a fd represents a directory. */
-  SYS_INUMBER  /* Returns the inode number for a fd. */
+  SYS_INUMBER, /* Returns the inode number for a fd. */
+
+  /* Statistics, numbered after the rest so that existing
+     programs keep working. */
+  SYS_LOCKSTAT, /* Reads kernel lock contention statistics. */
+  SYS_SYSSTAT   /* Reads system call statistics. */
 };
 
 #endif /* lib/syscall-nr.h */
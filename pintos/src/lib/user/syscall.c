@@ -53,6 +53,12 @@
 
 int practice(int i) { return syscall1(SYS_PRACTICE, i); }
 
+int lockstat(struct lockstat* stats, int max) { return syscall2(SYS_LOCKSTAT, stats, max); }
+
+bool sysstat(int number, bool system, struct sysstat* stats) {
+  return syscall3(SYS_SYSSTAT, number, (int)system, stats);
+}
+
 void halt(void) {
   syscall0(SYS_HALT);
   NOT_REACHED();
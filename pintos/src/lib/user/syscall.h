@@ -15,6 +15,34 @@ typedef int mapid_t;
 /* Maximum characters in a filename written by readdir(). */
 #define READDIR_MAX_LEN 14
 
+/* Maximum characters in a lock name written by lockstat(). */
+#define LOCKSTAT_NAME_MAX 15
+
+/* Contention statistics for one kernel lock name, as written by
+   lockstat().  Times are in timer ticks. */
+struct lockstat {
+  char name[LOCKSTAT_NAME_MAX + 1]; /* Lock name, null terminated. */
+  unsigned acquired;                /* Number of acquisitions. */
+  unsigned contended;               /* Acquisitions that found it held. */
+  long long wait_ticks;             /* Total time spent waiting. */
+  long long max_wait;               /* Longest single wait. */
+  long long hold_ticks;             /* Total time held. */
+  long long max_hold;               /* Longest single hold. */
+};
+
+/* Number of latency buckets in a struct sysstat. */
+#define SYSSTAT_BUCKETS 32
+
+/* Statistics for one system call number, as written by
+   sysstat().  HIST[I] counts the calls that took at least 2**I
+   but less than 2**(I+1) time-stamp counter cycles; the last
+   bucket also counts anything longer. */
+struct sysstat {
+  unsigned calls;                 /* Number of calls. */
+  unsigned errors;                /* Calls that failed or were killed. */
+  unsigned hist[SYSSTAT_BUCKETS]; /* Calls by log2 of their latency. */
+};
+
 /* Typical return values from main() and arguments to exit(). */
 #define EXIT_SUCCESS 0 /* Successful execution. */
 #define EXIT_FAILURE 1 /* Unsuccessful execution. */
@@ -34,6 +62,8 @@ void seek(int fd, unsigned position);
 unsigned tell(int fd);
 void close(int fd);
 int practice(int i);
+int lockstat(struct lockstat*, int max);
+bool sysstat(int number, bool system, struct sysstat*);
 
 /* Project 3 and optionally project 4. */
 mapid_t mmap(int fd, void* addr);
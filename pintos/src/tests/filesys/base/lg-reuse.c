@@ -0,0 +1,32 @@
+/* Writes a file that takes up more than half of the disk,
+   removes it, and does so again, then creates it once more at
+   full size.  This only works if removing the file gives its
+   data sectors back to the free map. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE (1200 * 1024)
+
+static char buf[4096];
+
+void test_main(void) {
+  const char* file_name = "reuse";
+  size_t ofs;
+  int fd, round;
+
+  for (round = 0; round < 2; round++) {
+    CHECK(create(file_name, 0), "create \"%s\"", file_name);
+    CHECK((fd = open(file_name)) > 1, "open \"%s\"", file_name);
+    msg("writing \"%s\"", file_name);
+    for (ofs = 0; ofs < FILE_SIZE; ofs += sizeof buf)
+      if (write(fd, buf, sizeof buf) != (int)sizeof buf)
+        fail("write %zu bytes at offset %zu in \"%s\" failed", sizeof buf, ofs, file_name);
+    msg("close \"%s\"", file_name);
+    close(fd);
+    CHECK(remove(file_name), "remove \"%s\"", file_name);
+  }
+  CHECK(create(file_name, FILE_SIZE), "create \"%s\" with %d bytes", file_name, FILE_SIZE);
+  CHECK(remove(file_name), "remove \"%s\"", file_name);
+}
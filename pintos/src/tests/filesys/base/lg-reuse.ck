@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(lg-reuse) begin
+(lg-reuse) create "reuse"
+(lg-reuse) open "reuse"
+(lg-reuse) writing "reuse"
+(lg-reuse) close "reuse"
+(lg-reuse) remove "reuse"
+(lg-reuse) create "reuse"
+(lg-reuse) open "reuse"
+(lg-reuse) writing "reuse"
+(lg-reuse) close "reuse"
+(lg-reuse) remove "reuse"
+(lg-reuse) create "reuse" with 1228800 bytes
+(lg-reuse) remove "reuse"
+(lg-reuse) end
+lg-reuse: exit(0)
+EOF
+pass;
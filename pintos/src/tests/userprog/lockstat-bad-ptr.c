@@ -0,0 +1,11 @@
+/* Passes an invalid pointer to the lockstat system call.
+   The process must be terminated with -1 exit code. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void test_main(void) {
+  lockstat((struct lockstat*)0xc0100000, 1);
+  fail("should not have survived lockstat()");
+}
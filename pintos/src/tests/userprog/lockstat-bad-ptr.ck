@@ -0,0 +1,9 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(lockstat-bad-ptr) begin
+lockstat-bad-ptr: exit(-1)
+EOF
+pass;
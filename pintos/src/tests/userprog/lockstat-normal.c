@@ -0,0 +1,39 @@
+/* Reads the kernel's lock contention statistics, which the test
+   runs with -lockstat to turn on, and checks that the records
+   returned are consistent and include the system call layer's
+   file system lock. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* As many lock names as the kernel keeps statistics for. */
+#define MAX_LOCKS 32
+
+void test_main(void) {
+  struct lockstat stats[MAX_LOCKS];
+  bool found_filesys = false;
+  int cnt, i;
+
+  cnt = lockstat(stats, MAX_LOCKS);
+  if (cnt <= 0 || cnt > MAX_LOCKS)
+    fail("lockstat() returned %d records, expected 1 to %d", cnt, MAX_LOCKS);
+  for (i = 0; i < cnt; i++) {
+    const struct lockstat* s = &stats[i];
+    size_t len = strnlen(s->name, sizeof s->name);
+
+    if (len == 0 || len == sizeof s->name)
+      fail("record %d has no null-terminated name", i);
+    if (s->contended > s->acquired)
+      fail("%s: contended %u times but acquired only %u", s->name, s->contended, s->acquired);
+    if (s->max_wait > s->wait_ticks || s->max_hold > s->hold_ticks)
+      fail("%s: longest wait or hold exceeds the total", s->name);
+    if (!strcmp(s->name, "filesys_lock"))
+      found_filesys = true;
+  }
+  CHECK(found_filesys, "filesys_lock has a record");
+
+  CHECK(lockstat(stats, 0) == 0, "lockstat() with room for no records");
+  CHECK(lockstat(stats, -1) == 0, "lockstat() with a negative count");
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(lockstat-normal) begin
+(lockstat-normal) filesys_lock has a record
+(lockstat-normal) lockstat() with room for no records
+(lockstat-normal) lockstat() with a negative count
+(lockstat-normal) end
+lockstat-normal: exit(0)
+EOF
+pass;
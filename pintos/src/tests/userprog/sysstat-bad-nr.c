@@ -0,0 +1,15 @@
+/* Asks sysstat() about numbers that are not system calls, which
+   must fail without killing the process. */
+
+#include <syscall.h>
+#include <syscall-nr.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void test_main(void) {
+  struct sysstat s;
+
+  CHECK(!sysstat(-1, false, &s), "sysstat(-1) fails");
+  CHECK(!sysstat(SYS_SYSSTAT + 1, false, &s), "sysstat() past the last system call fails");
+  CHECK(!sysstat(SYS_SYSSTAT + 1, true, &s), "sysstat() past the last, for all processes, fails");
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(sysstat-bad-nr) begin
+(sysstat-bad-nr) sysstat(-1) fails
+(sysstat-bad-nr) sysstat() past the last system call fails
+(sysstat-bad-nr) sysstat() past the last, for all processes, fails
+(sysstat-bad-nr) end
+sysstat-bad-nr: exit(0)
+EOF
+pass;
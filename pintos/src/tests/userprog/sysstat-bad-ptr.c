@@ -0,0 +1,12 @@
+/* Passes an invalid pointer to the sysstat system call.
+   The process must be terminated with -1 exit code. */
+
+#include <syscall.h>
+#include <syscall-nr.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void test_main(void) {
+  sysstat(SYS_PRACTICE, false, (struct sysstat*)0xc0100000);
+  fail("should not have survived sysstat()");
+}
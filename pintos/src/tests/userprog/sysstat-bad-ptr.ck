@@ -0,0 +1,9 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(sysstat-bad-ptr) begin
+sysstat-bad-ptr: exit(-1)
+EOF
+pass;
@@ -0,0 +1,51 @@
+/* Makes a few system calls and checks that sysstat() counts
+   them, both for this process and over all processes, including
+   a call that gets a child process killed for a bad pointer. */
+
+#include <syscall.h>
+#include <syscall-nr.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Returns the number of calls in S's latency histogram. */
+static unsigned timed_calls(const struct sysstat* s) {
+  unsigned total = 0;
+  int i;
+
+  for (i = 0; i < SYSSTAT_BUCKETS; i++)
+    total += s->hist[i];
+  return total;
+}
+
+void test_main(void) {
+  struct sysstat s, before;
+
+  practice(1);
+  practice(2);
+  open("no-such-file");
+
+  CHECK(sysstat(SYS_PRACTICE, false, &s), "sysstat(SYS_PRACTICE) for this process");
+  if (s.calls != 2 || s.errors != 0 || timed_calls(&s) != 2)
+    fail("%u calls, %u errors, %u timed; expected 2, 0 and 2", s.calls, s.errors,
+         timed_calls(&s));
+
+  CHECK(sysstat(SYS_OPEN, false, &s), "sysstat(SYS_OPEN) for this process");
+  if (s.calls != 1 || s.errors != 1 || timed_calls(&s) != 1)
+    fail("%u calls, %u errors, %u timed; expected 1, 1 and 1", s.calls, s.errors,
+         timed_calls(&s));
+
+  CHECK(sysstat(SYS_PRACTICE, true, &s), "sysstat(SYS_PRACTICE) for all processes");
+  if (s.calls < 2 || s.errors > s.calls || timed_calls(&s) != s.calls)
+    fail("%u calls, %u errors, %u timed; expected at least 2 calls, all timed", s.calls,
+         s.errors, timed_calls(&s));
+
+  /* The child's sysstat() call is killed while checking its
+     arguments.  It counts as a call and an error, and this
+     process's second sysstat() call counts as another call. */
+  CHECK(sysstat(SYS_SYSSTAT, true, &before), "sysstat(SYS_SYSSTAT) for all processes");
+  msg("wait(exec()) = %d", wait(exec("sysstat-bad-ptr")));
+  CHECK(sysstat(SYS_SYSSTAT, true, &s), "sysstat(SYS_SYSSTAT) for all processes");
+  if (s.calls != before.calls + 2 || s.errors != before.errors + 1)
+    fail("%u calls, %u errors; expected %u and %u", s.calls, s.errors, before.calls + 2,
+         before.errors + 1);
+}
@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(sysstat-normal) begin
+(sysstat-normal) sysstat(SYS_PRACTICE) for this process
+(sysstat-normal) sysstat(SYS_OPEN) for this process
+(sysstat-normal) sysstat(SYS_PRACTICE) for all processes
+(sysstat-normal) sysstat(SYS_SYSSTAT) for all processes
+(sysstat-bad-ptr) begin
+sysstat-bad-ptr: exit(-1)
+(sysstat-normal) wait(exec()) = -1
+(sysstat-normal) sysstat(SYS_SYSSTAT) for all processes
+(sysstat-normal) end
+sysstat-normal: exit(0)
+EOF
+pass;
@@ -20,6 +20,8 @@
 #include "threads/loader.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/profile.h"
+#include "threads/trace.h"
 #include "threads/pte.h"
 #include "threads/thread.h"
 #ifdef USERPROG
@@ -34,10 +36,12 @@
 #ifdef FILESYS
 #include "devices/block.h"
 #include "devices/ide.h"
+#include "devices/ramdisk.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
 #include "filesys/buffer.h"
 #include "filesys/directory.h"
+#include "filesys/inode.h"
 #endif
 
 /* Page directory with kernel mappings only. */
@@ -51,6 +55,9 @@ static bool format_filesys;
    overriding the defaults. */
 static const char* filesys_bdev_name;
 static const char* scratch_bdev_name;
+
+/* -ramdisk: Size of the RAM disk in sectors, 0 for none. */
+static block_sector_t ramdisk_sectors;
 #ifdef VM
 static const char* swap_bdev_name;
 #endif
@@ -106,6 +113,8 @@ int main(void) {
   /* Initialize interrupt handlers. */
   intr_init();
   timer_init();
+  profile_init();
+  trace_init();
   kbd_init();
   input_init();
 #ifdef USERPROG
@@ -121,6 +130,8 @@ int main(void) {
 #ifdef FILESYS
   /* Initialize file system. */
   ide_init();
+  if (ramdisk_sectors > 0)
+    ramdisk_init(ramdisk_sectors);
   locate_block_devices();
   filesys_init(format_filesys);
   //thread_current()->cwd = dir_open_root();
@@ -130,7 +141,9 @@ int main(void) {
 
   /* Run actions specified on kernel command line. */
   run_actions(argv);
+#ifdef FILESYS
   buffer_flush();
+#endif
   /* Finish up. */
   shutdown();
   thread_exit();
@@ -234,6 +247,39 @@ static char** parse_options(char** argv) {
       filesys_bdev_name = value;
     else if (!strcmp(name, "-scratch"))
       scratch_bdev_name = value;
+    else if (!strcmp(name, "-bigdisks"))
+      ide_big_disks = true;
+    else if (!strcmp(name, "-ramdisk")) {
+      char* end = NULL;
+      unsigned long sectors = value != NULL ? strtoul(value, &end, 10) : 0;
+      if (sectors == 0 || *end != '\0')
+        PANIC("-ramdisk takes a positive number of sectors (use -h for help)");
+      /* Out-of-range sizes come back as ULONG_MAX and fail the
+         kernel pool check below. */
+      ramdisk_sectors = sectors;
+    } else if (!strcmp(name, "-cache")) {
+      char* end = NULL;
+      unsigned long sectors = value != NULL ? strtoul(value, &end, 10) : 0;
+      if (sectors < BUFFER_MIN_SECTORS || *end != '\0')
+        PANIC("-cache takes at least %d sectors (use -h for help)", BUFFER_MIN_SECTORS);
+      /* Checked against the kernel pool below, like -ramdisk. */
+      buffer_cache_sectors = sectors;
+    } else if (!strcmp(name, "-flush")) {
+      int ms = value != NULL ? atoi(value) : 0;
+      if (ms < BUFFER_MIN_FLUSH_MS || ms > BUFFER_MAX_FLUSH_MS)
+        PANIC("-flush takes %d to %d ms (use -h for help)", BUFFER_MIN_FLUSH_MS,
+              BUFFER_MAX_FLUSH_MS);
+      buffer_flush_ms = ms;
+    } else if (!strcmp(name, "-dirty")) {
+      int pct = value != NULL ? atoi(value) : 0;
+      if (pct < BUFFER_MIN_DIRTY_PCT || pct > BUFFER_MAX_DIRTY_PCT)
+        PANIC("-dirty takes %d to %d percent (use -h for help)", BUFFER_MIN_DIRTY_PCT,
+              BUFFER_MAX_DIRTY_PCT);
+      buffer_dirty_pct = pct;
+    } else if (!strcmp(name, "-extents"))
+      inode_use_extents = true;
+    else if (!strcmp(name, "-hashdirs"))
+      dir_use_hash = true;
 #ifdef VM
     else if (!strcmp(name, "-swap"))
       swap_bdev_name = value;
@@ -243,14 +289,54 @@ static char** parse_options(char** argv) {
       random_init(atoi(value));
     else if (!strcmp(name, "-mlfqs"))
       thread_mlfqs = true;
+    else if (!strcmp(name, "-tickless"))
+      timer_tickless = true;
+    else if (!strcmp(name, "-lockstat"))
+      lock_profiling = true;
+    else if (!strcmp(name, "-profile"))
+      profile_depth = value != NULL ? atoi(value) : 1;
+    else if (!strcmp(name, "-trace"))
+      trace_dump_to = value != NULL && !strcmp(value, "scratch") ? TRACE_SCRATCH : TRACE_CONSOLE;
 #ifdef USERPROG
     else if (!strcmp(name, "-ul"))
       user_page_limit = atoi(value);
+    else if (!strcmp(name, "-syscallstats"))
+      syscall_stats_per_process = true;
 #endif
     else
       PANIC("unknown option `%s' (use -h for help)", name);
   }
 
+#ifdef FILESYS
+  /* The buffer cache and the RAM disk come out of the kernel pool,
+     whose size depends on -ul, so they can only be checked once
+     all options are in.  The cache must leave BUFFER_RESERVE_PAGES
+     free; the RAM disk must leave room for the cache and for
+     RAMDISK_RESERVE_PAGES more.  A cache with more sectors than
+     fit in the pool is rejected before buffer_cache_pages() can
+     overflow. */
+  size_t pool_pages = palloc_kernel_pages(user_page_limit);
+  if (buffer_cache_sectors > pool_pages * (PGSIZE / BLOCK_SECTOR_SIZE) ||
+      buffer_cache_pages(buffer_cache_sectors) + BUFFER_RESERVE_PAGES > pool_pages) {
+    size_t avail_pages = pool_pages > BUFFER_RESERVE_PAGES ? pool_pages - BUFFER_RESERVE_PAGES : 0;
+    size_t max_sectors = avail_pages * (PGSIZE / BLOCK_SECTOR_SIZE) + 1;
+    while (max_sectors > 0 && buffer_cache_pages(max_sectors) > avail_pages)
+      max_sectors--;
+    PANIC("-cache takes %d to %zu sectors with this memory size and -ul (use -h for help)",
+          BUFFER_MIN_SECTORS, max_sectors);
+  }
+  if (ramdisk_sectors > 0) {
+    size_t reserve_pages = RAMDISK_RESERVE_PAGES + buffer_cache_pages(buffer_cache_sectors);
+    size_t max_sectors = 0;
+    if (pool_pages > reserve_pages)
+      max_sectors = (pool_pages - reserve_pages) * (PGSIZE / BLOCK_SECTOR_SIZE);
+    if (ramdisk_sectors > max_sectors)
+      PANIC("-ramdisk takes at most %zu sectors with this memory size, -ul and -cache "
+            "(use -h for help)",
+            max_sectors);
+  }
+#endif
+
   /* Initialize the random number generator based on the system
      time.  This has no effect if an "-rs" option was specified.
 
@@ -350,14 +436,26 @@ static void usage(void) {
          "  -f                 Format file system device during startup.\n"
          "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
          "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
+         "  -bigdisks          Use IDE disks of 1 GB or more (LBA48 above 128 GB).\n"
+         "  -ramdisk=SECTORS   Create RAM disk rd0 of SECTORS sectors.\n"
+         "  -cache=SECTORS     Cache SECTORS disk sectors in memory.\n"
+         "  -flush=MS          Write dirty cached sectors back every MS ms.\n"
+         "  -dirty=PERCENT     Write back early once PERCENT of cache is dirty.\n"
+         "  -extents           Lay out new files as extents of contiguous sectors.\n"
+         "  -hashdirs          Index new directories by a hash of each name.\n"
 #ifdef VM
          "  -swap=BDEV         Use BDEV for swap instead of default.\n"
 #endif
 #endif
          "  -rs=SEED           Set random number seed to SEED.\n"
          "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+         "  -tickless          Stop the periodic timer interrupt while idle.\n"
+         "  -lockstat          Count waits on named locks, print at shutdown.\n"
+         "  -profile[=DEPTH]   Sample code addresses, DEPTH calls deep, every tick.\n"
+         "  -trace[=scratch]   Trace kernel events, dump to console or scratch disk.\n"
 #ifdef USERPROG
          "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+         "  -syscallstats      Print each process's system call statistics at exit.\n"
 #endif
   );
   shutdown_power_off();
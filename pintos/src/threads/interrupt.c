@@ -233,6 +233,21 @@ static void pic_init(void) {
   outb(PIC1_DATA, 0x00);
 }
 
+/* Returns true if external interrupt VEC_NO has been raised but
+   not yet delivered, as when interrupts are off.  Reads the
+   interrupt request register of VEC_NO's PIC. */
+bool intr_pending(uint8_t vec_no) {
+  ASSERT(vec_no >= 0x20 && vec_no <= 0x2f);
+
+  if (vec_no < 0x28) {
+    outb(PIC0_CTRL, 0x0a); /* OCW3: read IRR. */
+    return (inb(PIC0_CTRL) >> (vec_no - 0x20)) & 1;
+  } else {
+    outb(PIC1_CTRL, 0x0a); /* OCW3: read IRR. */
+    return (inb(PIC1_CTRL) >> (vec_no - 0x28)) & 1;
+  }
+}
+
 /* Sends an end-of-interrupt signal to the PIC for the given IRQ.
    If we don't acknowledge the IRQ, it will never be delivered to
    us again, so this is important.  */
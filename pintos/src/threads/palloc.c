@@ -38,6 +38,18 @@ static struct pool kernel_pool, user_pool;
 static void init_pool(struct pool*, void* base, size_t page_cnt, const char* name);
 static bool page_from_pool(const struct pool*, void* page);
 
+/* Returns the number of pages palloc_init() will put into the
+   kernel pool, given the same USER_PAGE_LIMIT.  May be called
+   before palloc_init(). */
+size_t palloc_kernel_pages(size_t user_page_limit) {
+  /* Free memory starts at 1 MB and runs to the end of RAM. */
+  size_t free_pages = init_ram_pages - 1024 * 1024 / PGSIZE;
+  size_t user_pages = free_pages / 2;
+  if (user_pages > user_page_limit)
+    user_pages = user_page_limit;
+  return free_pages - user_pages;
+}
+
 /* Initializes the page allocator.  At most USER_PAGE_LIMIT
    pages are put into the user pool. */
 void palloc_init(size_t user_page_limit) {
@@ -45,11 +57,8 @@ void palloc_init(size_t user_page_limit) {
   uint8_t* free_start = ptov(1024 * 1024);
   uint8_t* free_end = ptov(init_ram_pages * PGSIZE);
   size_t free_pages = (free_end - free_start) / PGSIZE;
-  size_t user_pages = free_pages / 2;
-  size_t kernel_pages;
-  if (user_pages > user_page_limit)
-    user_pages = user_page_limit;
-  kernel_pages = free_pages - user_pages;
+  size_t kernel_pages = palloc_kernel_pages(user_page_limit);
+  size_t user_pages = free_pages - kernel_pages;
 
   /* Give half of memory to kernel, half to user. */
   init_pool(&kernel_pool, free_start, kernel_pages, "kernel pool");
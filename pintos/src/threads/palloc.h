@@ -11,6 +11,7 @@ enum palloc_flags {
 };
 
 void palloc_init(size_t user_page_limit);
+size_t palloc_kernel_pages(size_t user_page_limit);
 void* palloc_get_page(enum palloc_flags);
 void* palloc_get_multiple(enum palloc_flags, size_t page_cnt);
 void palloc_free_page(void*);
@@ -0,0 +1,134 @@
+#include "threads/profile.h"
+#include <debug.h>
+#include <hash.h>
+#include <round.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#ifdef USERPROG
+#include "userprog/pagedir.h"
+#endif
+
+/* Sampling profiler.
+
+   On every timer interrupt, profile_sample() records where the
+   interrupted code was: its instruction pointer and, for a
+   profile_depth above 1, the return addresses of its callers,
+   found by following the saved frame pointers.  Both kernel and
+   user code are sampled.  Samples are counted in a fixed table,
+   allocated once at boot, keyed by the addresses and, for user
+   code, the process name, so that the same address in different
+   programs is kept apart.
+
+   The table is printed at shutdown, one line per distinct
+   sample, for utils/profile to turn into function names. */
+
+/* A distinct sample. */
+struct sample {
+  char name[16];               /* Process name, empty for the kernel. */
+  uintptr_t pc[PROFILE_DEPTH]; /* Interrupted EIP, then return addresses. */
+  unsigned count;              /* Times seen, 0 if the slot is free. */
+};
+
+/* Bytes of a sample that identify it. */
+#define SAMPLE_KEY offsetof(struct sample, count)
+
+/* Slots looked at before a sample is given up on. */
+#define PROFILE_PROBES 16
+
+int profile_depth;
+
+static struct sample* samples; /* PROFILE_SLOTS samples, or NULL. */
+static unsigned sample_cnt;    /* Samples counted. */
+static unsigned lost_cnt;      /* Samples dropped, table full. */
+
+/* Allocates the sample table, if profiling was asked for. */
+void profile_init(void) {
+  if (profile_depth <= 0)
+    return;
+  if (profile_depth > PROFILE_DEPTH)
+    profile_depth = PROFILE_DEPTH;
+  samples = palloc_get_multiple(PAL_ASSERT | PAL_ZERO,
+                                DIV_ROUND_UP(PROFILE_SLOTS * sizeof *samples, PGSIZE));
+}
+
+/* Returns true if the stack frame at FP, a saved frame pointer
+   and a return address, can be read from the timer interrupt.  A
+   kernel frame must lie in the current thread's stack page, a
+   user frame in a mapped user page. */
+static bool frame_readable(uintptr_t fp, bool user) {
+  if (fp % sizeof(uintptr_t) != 0 || pg_ofs((void*)fp) > PGSIZE - 2 * sizeof(uintptr_t))
+    return false;
+#ifdef USERPROG
+  if (user)
+    return is_user_vaddr((void*)fp) &&
+           pagedir_get_page(thread_current()->pagedir, (void*)fp) != NULL;
+#endif
+  return !user && pg_round_down((void*)fp) == (void*)thread_current();
+}
+
+/* Records a sample of the code interrupted at F.  Called from the
+   timer interrupt. */
+void profile_sample(const struct intr_frame* f) {
+  struct sample key;
+  bool user = (f->cs & 3) == 3;
+  uintptr_t fp = f->ebp;
+  unsigned h;
+
+  ASSERT(intr_context());
+  if (samples == NULL)
+    return;
+
+  memset(&key, 0, sizeof key);
+  if (user)
+    strlcpy(key.name, thread_current()->name, sizeof key.name);
+  key.pc[0] = (uintptr_t)f->eip;
+  for (int d = 1; d < profile_depth && frame_readable(fp, user); d++) {
+    const uintptr_t* frame = (const uintptr_t*)fp;
+    key.pc[d] = frame[1];
+    if (frame[0] <= fp) // callers' frames are further up the stack
+      break;
+    fp = frame[0];
+  }
+
+  h = hash_bytes(&key, SAMPLE_KEY);
+  for (int i = 0; i < PROFILE_PROBES; i++) {
+    struct sample* s = &samples[(h + i) & (PROFILE_SLOTS - 1)];
+    if (s->count == 0)
+      memcpy(s, &key, SAMPLE_KEY);
+    if (!memcmp(s, &key, SAMPLE_KEY)) {
+      s->count++;
+      sample_cnt++;
+      return;
+    }
+  }
+  lost_cnt++;
+}
+
+/* Prints every distinct sample as "prof COUNT NAME ADDRESS...",
+   where NAME is "kernel" for kernel code. */
+void profile_print_stats(void) {
+  if (samples == NULL)
+    return;
+  printf("Profile: %u samples, %u lost\n", sample_cnt, lost_cnt);
+  for (size_t i = 0; i < PROFILE_SLOTS; i++) {
+    enum intr_level old_level;
+    struct sample s;
+
+    // copy it out so the timer cannot change it under us
+    old_level = intr_disable();
+    s = samples[i];
+    intr_set_level(old_level);
+    if (s.count == 0)
+      continue;
+    printf("prof %u %s", s.count, s.name[0] != '\0' ? s.name : "kernel");
+    for (int d = 0; d < PROFILE_DEPTH && s.pc[d] != 0; d++)
+      printf(" %p", (void*)s.pc[d]);
+    printf("\n");
+  }
+}
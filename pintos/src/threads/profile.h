@@ -0,0 +1,21 @@
+#ifndef THREADS_PROFILE_H
+#define THREADS_PROFILE_H
+
+struct intr_frame;
+
+/* Most addresses recorded per sample: the interrupted
+   instruction and the return addresses of its callers. */
+#define PROFILE_DEPTH 4
+
+/* Number of distinct samples kept, a power of 2. */
+#define PROFILE_SLOTS 2048
+
+/* Addresses recorded per sample, 0 to turn the profiler off.
+   Set by the "-profile" kernel command-line option. */
+extern int profile_depth;
+
+void profile_init(void);
+void profile_sample(const struct intr_frame*);
+void profile_print_stats(void);
+
+#endif /* threads/profile.h */
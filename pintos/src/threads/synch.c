@@ -26,9 +26,19 @@
 #include "threads/synch.h"
 #include <stdio.h>
 #include <string.h>
+#include "devices/timer.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 
+/* If true, named locks keep contention statistics.
+   Controlled by kernel command-line option "-lockstat". */
+bool lock_profiling;
+
+/* Statistics for each distinct lock name, in order of first
+   use.  Only grows; protected by disabling interrupts. */
+static struct lock_stats lock_stats[LOCK_STATS_MAX];
+static size_t lock_stats_cnt;
+
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
    manipulating it:
@@ -86,7 +96,9 @@ bool sema_try_down(struct semaphore* sema) {
 }
 
 /* Up or "V" operation on a semaphore.  Increments SEMA's value
-   and wakes up one thread of those waiting for SEMA, if any.
+   and wakes up the highest-priority thread of those waiting for
+   SEMA, if any, first come first served among equals.  Yields
+   to the woken thread if it has a higher priority than ours.
    This function may be called from an interrupt handler. */
 void sema_up(struct semaphore* sema) {
   enum intr_level old_level;
@@ -94,10 +106,14 @@ void sema_up(struct semaphore* sema) {
   ASSERT(sema != NULL);
 
   old_level = intr_disable();
-  if (!list_empty(&sema->waiters))
-    thread_unblock(list_entry(list_pop_front(&sema->waiters), struct thread, elem));
+  if (!list_empty(&sema->waiters)) {
+    struct list_elem* e = list_max(&sema->waiters, thread_priority_less, NULL);
+    list_remove(e);
+    thread_unblock(list_entry(e, struct thread, elem));
+  }
   sema->value++;
   intr_set_level(old_level);
+  thread_preempt();
 }
 
 static void sema_test_helper(void* sema_);
@@ -149,52 +165,180 @@ void lock_init(struct lock* lock) {
   ASSERT(lock != NULL);
 
   lock->holder = NULL;
+  lock->stats = NULL;
   sema_init(&lock->semaphore, 1);
 }
 
+/* Names LOCK for the contention profiler, which then counts its
+   acquisitions, waits and holds under NAME, adding them up with
+   those of any other lock of the same name.  NAME must stay
+   valid for the life of the kernel.  Does nothing unless
+   lock_profiling is set, or once LOCK_STATS_MAX names are in
+   use. */
+void lock_set_name(struct lock* lock, const char* name) {
+  enum intr_level old_level;
+  size_t i;
+
+  ASSERT(lock != NULL);
+  ASSERT(name != NULL);
+
+  if (!lock_profiling)
+    return;
+  old_level = intr_disable();
+  for (i = 0; i < lock_stats_cnt; i++)
+    if (!strcmp(lock_stats[i].name, name))
+      break;
+  if (i == lock_stats_cnt && lock_stats_cnt < LOCK_STATS_MAX)
+    lock_stats[lock_stats_cnt++].name = name;
+  if (i < lock_stats_cnt)
+    lock->stats = &lock_stats[i];
+  intr_set_level(old_level);
+}
+
+/* Copies the statistics for the IDX'th lock name into *STATS.
+   Returns false if there are not that many names. */
+bool lock_get_stats(size_t idx, struct lock_stats* stats) {
+  enum intr_level old_level;
+  bool found;
+
+  old_level = intr_disable();
+  found = idx < lock_stats_cnt;
+  if (found)
+    *stats = lock_stats[idx];
+  intr_set_level(old_level);
+  return found;
+}
+
+/* Prints contention statistics for every named lock. */
+void lock_print_stats(void) {
+  struct lock_stats s;
+
+  if (!lock_profiling)
+    return;
+  printf("Locks: name, acquired, contended, wait ticks (max), hold ticks (max)\n");
+  for (size_t i = 0; lock_get_stats(i, &s); i++)
+    printf("  %-16s %8u %8u %8lld (%lld) %8lld (%lld)\n", s.name, s.acquired, s.contended,
+           s.wait_ticks, s.max_wait, s.hold_ticks, s.max_hold);
+}
+
+/* Donates the current thread's priority to the holder of the
+   lock it is waiting for, and on along the chain of holders that
+   are themselves waiting for locks, up to DONATION_DEPTH deep.
+   Interrupts must be off. */
+static void donate_priority(void) {
+  struct thread* t = thread_current();
+  int depth;
+
+  for (depth = 0; depth < DONATION_DEPTH; depth++) {
+    struct lock* lock = t->waiting_lock;
+    if (lock == NULL || lock->holder == NULL || lock->holder->priority >= t->priority)
+      break;
+    thread_update_priority(lock->holder, t->priority);
+    t = lock->holder;
+  }
+}
+
+/* Records that the current thread now holds LOCK.  Interrupts
+   must be off. */
+static void take_lock(struct lock* lock) {
+  struct thread* cur = thread_current();
+
+  lock->holder = cur;
+  list_push_back(&cur->held_locks, &lock->elem);
+  if (lock->stats != NULL) {
+    lock->stats->acquired++;
+    lock->acquired_at = timer_ticks();
+  }
+}
+
 /* Acquires LOCK, sleeping until it becomes available if
    necessary.  The lock must not already be held by the current
-   thread.
+   thread.  While we wait, the holder runs with our priority if
+   that is higher than its own.
    This function may sleep, so it must not be called within an
    interrupt handler.  This function may be called with
    interrupts disabled, but interrupts will be turned back on if
    we need to sleep. */
 void lock_acquire(struct lock* lock) {
+  struct thread* cur = thread_current();
+  enum intr_level old_level;
+  bool timed = false;
+  int64_t start = 0;
+
   ASSERT(lock != NULL);
   ASSERT(!intr_context());
   ASSERT(!lock_held_by_current_thread(lock));
 
+  old_level = intr_disable();
+  if (lock->holder != NULL && lock->stats != NULL) {
+    lock->stats->contended++;
+    timed = true;
+    start = timer_ticks();
+  }
+  if (lock->holder != NULL && !thread_mlfqs) {
+    cur->waiting_lock = lock;
+    donate_priority();
+  }
   sema_down(&lock->semaphore);
-  lock->holder = thread_current();
+  cur->waiting_lock = NULL;
+  if (timed) {
+    int64_t waited = timer_elapsed(start);
+    lock->stats->wait_ticks += waited;
+    if (waited > lock->stats->max_wait)
+      lock->stats->max_wait = waited;
+  }
+  take_lock(lock);
+  intr_set_level(old_level);
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
-   on failure.  The lock must not already be held by the current
+   on failure.  A failure counts as a contended acquisition with
+   no wait.  The lock must not already be held by the current
    thread.
    This function will not sleep, so it may be called within an
    interrupt handler. */
 bool lock_try_acquire(struct lock* lock) {
+  enum intr_level old_level;
   bool success;
 
   ASSERT(lock != NULL);
   ASSERT(!lock_held_by_current_thread(lock));
 
+  old_level = intr_disable();
   success = sema_try_down(&lock->semaphore);
   if (success)
-    lock->holder = thread_current();
+    take_lock(lock);
+  else if (lock->stats != NULL)
+    lock->stats->contended++;
+  intr_set_level(old_level);
   return success;
 }
 
-/* Releases LOCK, which must be owned by the current thread.
+/* Releases LOCK, which must be owned by the current thread, and
+   gives up any priority donated through it.
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to release a lock within an interrupt
    handler. */
 void lock_release(struct lock* lock) {
+  struct thread* cur = thread_current();
+  enum intr_level old_level;
+
   ASSERT(lock != NULL);
   ASSERT(lock_held_by_current_thread(lock));
 
+  old_level = intr_disable();
+  if (lock->stats != NULL) {
+    int64_t held = timer_elapsed(lock->acquired_at);
+    lock->stats->hold_ticks += held;
+    if (held > lock->stats->max_hold)
+      lock->stats->max_hold = held;
+  }
+  list_remove(&lock->elem);
   lock->holder = NULL;
+  thread_refresh_priority(cur);
   sema_up(&lock->semaphore);
+  intr_set_level(old_level);
+  thread_preempt();
 }
 
 /* Returns true if the current thread holds LOCK, false
@@ -210,8 +354,17 @@ bool lock_held_by_current_thread(const struct lock* lock) {
 struct semaphore_elem {
   struct list_elem elem;      /* List element. */
   struct semaphore semaphore; /* This semaphore. */
+  struct thread* thread;      /* Thread waiting on it. */
 };
 
+/* Orders the waiters of a condition variable by the priority of
+   their threads. */
+static bool waiter_less(const struct list_elem* a_, const struct list_elem* b_, void* aux UNUSED) {
+  const struct semaphore_elem* a = list_entry(a_, struct semaphore_elem, elem);
+  const struct semaphore_elem* b = list_entry(b_, struct semaphore_elem, elem);
+  return a->thread->priority < b->thread->priority;
+}
+
 /* Initializes condition variable COND.  A condition variable
    allows one piece of code to signal a condition and cooperating
    code to receive the signal and act upon it. */
@@ -247,6 +400,7 @@ void cond_wait(struct condition* cond, struct lock* lock) {
   ASSERT(lock_held_by_current_thread(lock));
 
   sema_init(&waiter.semaphore, 0);
+  waiter.thread = thread_current();
   list_push_back(&cond->waiters, &waiter.elem);
   lock_release(lock);
   sema_down(&waiter.semaphore);
@@ -254,8 +408,8 @@ void cond_wait(struct condition* cond, struct lock* lock) {
 }
 
 /* If any threads are waiting on COND (protected by LOCK), then
-   this function signals one of them to wake up from its wait.
-   LOCK must be held before calling this function.
+   this function signals the highest-priority one to wake up from
+   its wait.  LOCK must be held before calling this function.
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to signal a condition variable within an
    interrupt handler. */
@@ -265,8 +419,11 @@ void cond_signal(struct condition* cond, struct lock* lock UNUSED) {
   ASSERT(!intr_context());
   ASSERT(lock_held_by_current_thread(lock));
 
-  if (!list_empty(&cond->waiters))
-    sema_up(&list_entry(list_pop_front(&cond->waiters), struct semaphore_elem, elem)->semaphore);
+  if (!list_empty(&cond->waiters)) {
+    struct list_elem* e = list_max(&cond->waiters, waiter_less, NULL);
+    list_remove(e);
+    sema_up(&list_entry(e, struct semaphore_elem, elem)->semaphore);
+  }
 }
 
 /* Wakes up all threads, if any, waiting on COND (protected by
@@ -281,3 +438,127 @@ void cond_broadcast(struct condition* cond, struct lock* lock) {
   while (!list_empty(&cond->waiters))
     cond_signal(cond, lock);
 }
+
+/* Initializes RWLOCK, not held by anyone. */
+void rwlock_init(struct rwlock* rwlock) {
+  ASSERT(rwlock != NULL);
+
+  lock_init(&rwlock->lock);
+  cond_init(&rwlock->readers);
+  cond_init(&rwlock->writers);
+  rwlock->reader_cnt = 0;
+  rwlock->writers_waiting = 0;
+  rwlock->writer = NULL;
+}
+
+/* Acquires RWLOCK for reading, sleeping while a writer holds it
+   or is waiting for it.  The current thread must not already hold
+   RWLOCK in either mode.
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void rwlock_acquire_read(struct rwlock* rwlock) {
+  ASSERT(rwlock != NULL);
+  ASSERT(!intr_context());
+  ASSERT(!rwlock_held_by_current_thread(rwlock));
+
+  lock_acquire(&rwlock->lock);
+  while (rwlock->writer != NULL || rwlock->writers_waiting > 0)
+    cond_wait(&rwlock->readers, &rwlock->lock);
+  rwlock->reader_cnt++;
+  lock_release(&rwlock->lock);
+}
+
+/* Acquires RWLOCK for writing, sleeping until no reader or
+   writer holds it.  The current thread must not already hold
+   RWLOCK in either mode.
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void rwlock_acquire_write(struct rwlock* rwlock) {
+  ASSERT(rwlock != NULL);
+  ASSERT(!intr_context());
+  ASSERT(!rwlock_held_by_current_thread(rwlock));
+
+  lock_acquire(&rwlock->lock);
+  rwlock->writers_waiting++;
+  while (rwlock->writer != NULL || rwlock->reader_cnt > 0)
+    cond_wait(&rwlock->writers, &rwlock->lock);
+  rwlock->writers_waiting--;
+  rwlock->writer = thread_current();
+  lock_release(&rwlock->lock);
+}
+
+/* Acquires RWLOCK for reading if that can be done without
+   waiting, and returns true if successful or false on failure.
+   Only waits, briefly, for the lock guarding RWLOCK's state. */
+bool rwlock_try_acquire_read(struct rwlock* rwlock) {
+  bool success;
+
+  ASSERT(rwlock != NULL);
+
+  lock_acquire(&rwlock->lock);
+  success = rwlock->writer == NULL && rwlock->writers_waiting == 0;
+  if (success)
+    rwlock->reader_cnt++;
+  lock_release(&rwlock->lock);
+  return success;
+}
+
+/* Acquires RWLOCK for writing if that can be done without
+   waiting, and returns true if successful or false on failure.
+   Only waits, briefly, for the lock guarding RWLOCK's state. */
+bool rwlock_try_acquire_write(struct rwlock* rwlock) {
+  bool success;
+
+  ASSERT(rwlock != NULL);
+
+  lock_acquire(&rwlock->lock);
+  success = rwlock->writer == NULL && rwlock->reader_cnt == 0;
+  if (success)
+    rwlock->writer = thread_current();
+  lock_release(&rwlock->lock);
+  return success;
+}
+
+/* Converts the current thread's write hold on RWLOCK into a read
+   hold, without letting any writer in between, and lets waiting
+   readers in if no writer is waiting. */
+void rwlock_downgrade(struct rwlock* rwlock) {
+  ASSERT(rwlock_held_by_current_thread(rwlock));
+
+  lock_acquire(&rwlock->lock);
+  rwlock->writer = NULL;
+  rwlock->reader_cnt++;
+  if (rwlock->writers_waiting == 0)
+    cond_broadcast(&rwlock->readers, &rwlock->lock);
+  lock_release(&rwlock->lock);
+}
+
+/* Releases RWLOCK, which the current thread must hold, for
+   writing if it holds it for writing and otherwise for reading.
+   The last reader out lets a waiting writer in; a writer lets in
+   the next waiting writer if there is one, otherwise all the
+   waiting readers. */
+void rwlock_release(struct rwlock* rwlock) {
+  ASSERT(rwlock != NULL);
+
+  lock_acquire(&rwlock->lock);
+  if (rwlock->writer == thread_current())
+    rwlock->writer = NULL;
+  else {
+    ASSERT(rwlock->reader_cnt > 0);
+    rwlock->reader_cnt--;
+  }
+  if (rwlock->writer == NULL && rwlock->reader_cnt == 0 && rwlock->writers_waiting > 0)
+    cond_signal(&rwlock->writers, &rwlock->lock);
+  else if (rwlock->writers_waiting == 0)
+    cond_broadcast(&rwlock->readers, &rwlock->lock);
+  lock_release(&rwlock->lock);
+}
+
+/* Returns true if the current thread holds RWLOCK for writing,
+   false otherwise.  Readers are not tracked by identity. */
+bool rwlock_held_by_current_thread(const struct rwlock* rwlock) {
+  ASSERT(rwlock != NULL);
+
+  return rwlock->writer == thread_current();
+}
@@ -3,6 +3,8 @@
 
 #include <list.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 /* A counting semaphore. */
 struct semaphore {
@@ -18,17 +20,44 @@ void sema_self_test(void);
 
 /* Lock. */
 struct lock {
-  struct thread* holder;      /* Thread holding lock (for debugging). */
+  struct thread* holder;      /* Thread holding lock. */
   struct semaphore semaphore; /* Binary semaphore controlling access. */
-  struct list_elem elem;
+  struct list_elem elem;      /* Element in holder's held_locks. */
+  struct lock_stats* stats;   /* Contention statistics, or NULL. */
+  int64_t acquired_at;        /* Tick of last acquisition, if STATS. */
 };
 
+/* Longest chain of lock holders that a donation is passed along. */
+#define DONATION_DEPTH 8
+
 void lock_init(struct lock*);
 void lock_acquire(struct lock*);
 bool lock_try_acquire(struct lock*);
 void lock_release(struct lock*);
 bool lock_held_by_current_thread(const struct lock*);
 
+/* Contention statistics, shared by all the locks given the same
+   name with lock_set_name().  Only kept when lock_profiling is
+   set, by the "-lockstat" kernel command-line option. */
+struct lock_stats {
+  const char* name;   /* Name given to lock_set_name(). */
+  unsigned acquired;  /* Number of acquisitions. */
+  unsigned contended; /* Acquisitions that found the lock held. */
+  int64_t wait_ticks; /* Total ticks spent waiting to acquire. */
+  int64_t max_wait;   /* Longest single wait, in ticks. */
+  int64_t hold_ticks; /* Total ticks the locks were held. */
+  int64_t max_hold;   /* Longest single hold, in ticks. */
+};
+
+/* Most distinct lock names that are tracked. */
+#define LOCK_STATS_MAX 32
+
+extern bool lock_profiling;
+
+void lock_set_name(struct lock*, const char* name);
+bool lock_get_stats(size_t idx, struct lock_stats*);
+void lock_print_stats(void);
+
 /* Condition variable. */
 struct condition {
   struct list waiters; /* List of waiting threads. */
@@ -39,6 +68,28 @@ void cond_wait(struct condition*, struct lock*);
 void cond_signal(struct condition*, struct lock*);
 void cond_broadcast(struct condition*, struct lock*);
 
+/* Reader-writer lock.  Any number of readers, or one writer, may
+   hold it at a time.  Writers are preferred: once a writer is
+   waiting, new readers wait behind it.  Waiting threads are
+   woken in priority order, as for condition variables. */
+struct rwlock {
+  struct lock lock;         /* Guards the members below. */
+  struct condition readers; /* Readers waiting to get in. */
+  struct condition writers; /* Writers waiting to get in. */
+  unsigned reader_cnt;      /* Number of readers holding it. */
+  unsigned writers_waiting; /* Number of writers waiting. */
+  struct thread* writer;    /* Writer holding it, or NULL. */
+};
+
+void rwlock_init(struct rwlock*);
+void rwlock_acquire_read(struct rwlock*);
+void rwlock_acquire_write(struct rwlock*);
+bool rwlock_try_acquire_read(struct rwlock*);
+bool rwlock_try_acquire_write(struct rwlock*);
+void rwlock_downgrade(struct rwlock*);
+void rwlock_release(struct rwlock*);
+bool rwlock_held_by_current_thread(const struct rwlock*);
+
 /* Optimization barrier.
 
    The compiler will not reorder operations across an
@@ -10,7 +10,9 @@
 #include "threads/palloc.h"
 #include "threads/switch.h"
 #include "threads/synch.h"
+#include "threads/trace.h"
 #include "threads/vaddr.h"
+#include "devices/timer.h"
 #include "filesys/directory.h"
 #ifdef USERPROG
 #include "userprog/process.h"
@@ -21,9 +23,14 @@
    of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
+/* Processes in THREAD_READY state, that is, processes that are
+   ready to run but not actually running: one FIFO queue per
+   priority, and a bitmap with bit P set when queue P is not
+   empty, so that finding the highest ready priority takes a
+   couple of instructions. */
+static struct list ready_queues[PRI_MAX + 1];
+static uint64_t ready_mask;
+static int ready_cnt; /* Number of threads in the ready queues. */
 
 /* List of all processes.  Processes are added to this list
    when they are first scheduled and removed when they exit. */
@@ -59,6 +66,18 @@ static unsigned thread_ticks; /* # of timer ticks since last yield. */
    Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
+/* MLFQS.  The system load average is updated once per second.
+   A thread's recent_cpu only changes on a tick while it is
+   running, so on most ticks only the running thread's recent_cpu
+   and priority need updating; every thread's are recomputed once
+   per second, when recent_cpu decays. */
+#define PRIORITY_PERIOD 4     /* Ticks between priority updates. */
+static fixed_point_t load_avg; /* Estimated ready threads, past minute. */
+
+static void mlfqs_tick(struct thread*);
+static void mlfqs_update_priority(struct thread*, void* aux);
+static void mlfqs_decay_recent_cpu(struct thread*, void* aux);
+
 static void kernel_thread(thread_func*, void* aux);
 
 static void idle(void* aux UNUSED);
@@ -68,6 +87,10 @@ static void init_thread(struct thread*, const char* name, int priority);
 static bool is_thread(struct thread*) UNUSED;
 static void* alloc_frame(struct thread*, size_t size);
 static void schedule(void);
+static void ready_push(struct thread*);
+static void ready_remove(struct thread*);
+static int ready_max_priority(void);
+static bool outranked(void);
 void thread_schedule_tail(struct thread* prev);
 static tid_t allocate_tid(void);
 
@@ -82,10 +105,16 @@ static tid_t allocate_tid(void);
    It is not safe to call thread_current() until this function
    finishes. */
 void thread_init(void) {
+  int pri;
+
   ASSERT(intr_get_level() == INTR_OFF);
 
   lock_init(&tid_lock);
-  list_init(&ready_list);
+  for (pri = PRI_MIN; pri <= PRI_MAX; pri++)
+    list_init(&ready_queues[pri]);
+  ready_mask = 0;
+  ready_cnt = 0;
+  load_avg = fix_int(0);
   list_init(&all_list);
 
   /* Set up a thread structure for the running thread. */
@@ -125,11 +154,73 @@ void thread_tick(void) {
   else
     kernel_ticks++;
 
+  if (thread_mlfqs)
+    mlfqs_tick(t);
+
   /* Enforce preemption. */
   if (++thread_ticks >= TIME_SLICE)
     intr_yield_on_return();
 }
 
+/* MLFQS bookkeeping for a timer tick while T is running.  Runs
+   in an external interrupt context. */
+static void mlfqs_tick(struct thread* t) {
+  static int64_t last;
+  int64_t now = timer_ticks();
+  bool new_second, new_period;
+
+  if (t != idle_thread)
+    t->recent_cpu = fix_add(t->recent_cpu, fix_int(1));
+
+  /* Tickless idle can advance the clock by several ticks at once,
+     so look for crossed boundaries rather than exact multiples. */
+  new_second = now / TIMER_FREQ != last / TIMER_FREQ;
+  new_period = now / PRIORITY_PERIOD != last / PRIORITY_PERIOD;
+  last = now;
+
+  if (new_second) {
+    int ready_threads = ready_cnt + (t != idle_thread);
+    load_avg = fix_add(fix_mul(fix_frac(59, 60), load_avg),
+                       fix_scale(fix_frac(1, 60), ready_threads));
+    thread_foreach(mlfqs_decay_recent_cpu, NULL);
+    thread_foreach(mlfqs_update_priority, NULL);
+  } else if (new_period)
+    mlfqs_update_priority(t, NULL);
+  else
+    return;
+
+  /* Priorities changed; someone ready may now outrank T. */
+  thread_preempt();
+}
+
+/* Decays T's recent_cpu by the load average, as done once per
+   second. */
+static void mlfqs_decay_recent_cpu(struct thread* t, void* aux UNUSED) {
+  fixed_point_t twice_load = fix_scale(load_avg, 2);
+  fixed_point_t coefficient = fix_div(twice_load, fix_add(twice_load, fix_int(1)));
+
+  if (t == idle_thread)
+    return;
+  t->recent_cpu = fix_add(fix_mul(coefficient, t->recent_cpu), fix_int(t->nice));
+}
+
+/* Recomputes T's priority from its recent_cpu and nice value,
+   moving T to its new ready queue if it is ready.  Interrupts
+   must be off. */
+static void mlfqs_update_priority(struct thread* t, void* aux UNUSED) {
+  int priority;
+
+  if (t == idle_thread)
+    return;
+  priority = PRI_MAX - fix_trunc(fix_unscale(t->recent_cpu, 4)) - t->nice * 2;
+  if (priority < PRI_MIN)
+    priority = PRI_MIN;
+  else if (priority > PRI_MAX)
+    priority = PRI_MAX;
+  t->base_priority = priority;
+  thread_update_priority(t, priority);
+}
+
 /* Prints thread statistics. */
 void thread_print_stats(void) {
   printf("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n", idle_ticks, kernel_ticks,
@@ -146,9 +237,8 @@ void thread_print_stats(void) {
    thread may run for any amount of time before the new thread is
    scheduled.  Use a semaphore or some other form of
    synchronization if you need to ensure ordering.
-   The code provided sets the new thread's `priority' member to
-   PRIORITY, but no actual priority scheduling is implemented.
-   Priority scheduling is the goal of Problem 1-3. */
+   If the new thread has a higher priority than the running
+   thread, it runs right away. */
 tid_t thread_create(const char* name, int priority, thread_func* function, void* aux) {
   struct thread* t;
   struct kernel_thread_frame* kf;
@@ -166,6 +256,7 @@ tid_t thread_create(const char* name, int priority, thread_func* function, void*
   /* Initialize thread. */
   init_thread(t, name, priority);
   tid = t->tid = allocate_tid();
+  trace_thread_name(tid, name);
   /* Stack frame for kernel_thread(). */
   kf = alloc_frame(t, sizeof *kf);
   kf->eip = NULL;
@@ -183,6 +274,7 @@ tid_t thread_create(const char* name, int priority, thread_func* function, void*
 
   /* Add to run queue. */
   thread_unblock(t);
+  thread_preempt();
 
   return tid;
 }
@@ -196,6 +288,7 @@ void thread_block(void) {
   ASSERT(!intr_context());
   ASSERT(intr_get_level() == INTR_OFF);
 
+  TRACE(TRACE_BLOCK, 0, 0, 0);
   thread_current()->status = THREAD_BLOCKED;
   schedule();
 }
@@ -206,7 +299,8 @@ void thread_block(void) {
    This function does not preempt the running thread.  This can
    be important: if the caller had disabled interrupts itself,
    it may expect that it can atomically unblock a thread and
-   update other data. */
+   update other data.  Callers that want T to run right away if
+   it outranks them call thread_preempt() afterward. */
 void thread_unblock(struct thread* t) {
   enum intr_level old_level;
 
@@ -214,8 +308,9 @@ void thread_unblock(struct thread* t) {
 
   old_level = intr_disable();
   ASSERT(t->status == THREAD_BLOCKED);
-  list_push_back(&ready_list, &t->elem);
+  ready_push(t);
   t->status = THREAD_READY;
+  TRACE(TRACE_UNBLOCK, t->tid, 0, 0);
   intr_set_level(old_level);
 }
 
@@ -271,7 +366,7 @@ void thread_yield(void) {
 
   old_level = intr_disable();
   if (cur != idle_thread)
-    list_push_back(&ready_list, &cur->elem);
+    ready_push(cur);
   cur->status = THREAD_READY;
   schedule();
   intr_set_level(old_level);
@@ -290,32 +385,146 @@ void thread_foreach(thread_action_func* func, void* aux) {
   }
 }
 
-/* Sets the current thread's priority to NEW_PRIORITY. */
-void thread_set_priority(int new_priority) { thread_current()->priority = new_priority; }
+/* Sets the current thread's priority to NEW_PRIORITY.  Its
+   effective priority stays raised while it holds locks that
+   higher-priority threads are waiting for.  Yields if the thread
+   no longer has the highest priority.  Ignored by the MLFQS,
+   which sets priorities itself. */
+void thread_set_priority(int new_priority) {
+  struct thread* cur = thread_current();
+  enum intr_level old_level;
+
+  ASSERT(PRI_MIN <= new_priority && new_priority <= PRI_MAX);
+  if (thread_mlfqs)
+    return;
+
+  old_level = intr_disable();
+  cur->base_priority = new_priority;
+  thread_refresh_priority(cur);
+  intr_set_level(old_level);
+  thread_preempt();
+}
 
-/* Returns the current thread's priority. */
+/* Returns the current thread's effective priority. */
 int thread_get_priority(void) { return thread_current()->priority; }
 
-/* Sets the current thread's nice value to NICE. */
-void thread_set_nice(int nice UNUSED) { /* Not yet implemented. */
+/* Sets T's effective priority to PRIORITY, moving T to the
+   matching ready queue if it is ready.  Interrupts must be
+   off. */
+void thread_update_priority(struct thread* t, int priority) {
+  ASSERT(intr_get_level() == INTR_OFF);
+  ASSERT(PRI_MIN <= priority && priority <= PRI_MAX);
+
+  if (t->priority == priority)
+    return;
+  if (t->status == THREAD_READY && t != idle_thread) {
+    ready_remove(t);
+    t->priority = priority;
+    ready_push(t);
+  } else
+    t->priority = priority;
 }
 
-/* Returns the current thread's nice value. */
-int thread_get_nice(void) {
-  /* Not yet implemented. */
-  return 0;
+/* Recomputes T's effective priority: its base priority, or the
+   priority of the highest-priority thread waiting for a lock
+   that T holds, whichever is higher.  The MLFQS does not donate
+   priority, so there it is simply the base priority.  Interrupts
+   must be off. */
+void thread_refresh_priority(struct thread* t) {
+  int priority = t->base_priority;
+  struct list_elem* e;
+
+  ASSERT(intr_get_level() == INTR_OFF);
+
+  if (thread_mlfqs) {
+    thread_update_priority(t, priority);
+    return;
+  }
+  for (e = list_begin(&t->held_locks); e != list_end(&t->held_locks); e = list_next(e)) {
+    struct list* waiters = &list_entry(e, struct lock, elem)->semaphore.waiters;
+    if (!list_empty(waiters)) {
+      struct thread* w =
+          list_entry(list_max(waiters, thread_priority_less, NULL), struct thread, elem);
+      if (w->priority > priority)
+        priority = w->priority;
+    }
+  }
+  thread_update_priority(t, priority);
 }
 
+/* Yields the CPU if a ready thread has a higher priority than
+   the running thread.  In an interrupt handler, yields on return
+   from the interrupt instead.  Does nothing if interrupts are
+   off, since the caller may rely on running atomically; such
+   callers should call this again once they turn interrupts
+   back on. */
+void thread_preempt(void) {
+  if (intr_context()) {
+    if (outranked())
+      intr_yield_on_return();
+  } else if (intr_get_level() == INTR_ON) {
+    bool yield;
+
+    intr_disable();
+    yield = outranked();
+    intr_enable();
+    if (yield)
+      thread_yield();
+  }
+}
+
+/* Returns true if a ready thread has a higher priority than the
+   running thread.  The idle thread is outranked by any ready
+   thread, whatever its priority field says.  Interrupts must be
+   off. */
+static bool outranked(void) {
+  struct thread* cur = thread_current();
+  return ready_max_priority() > (cur == idle_thread ? PRI_MIN - 1 : cur->priority);
+}
+
+/* Orders threads, given by their `elem' members, by ascending
+   effective priority. */
+bool thread_priority_less(const struct list_elem* a_, const struct list_elem* b_,
+                          void* aux UNUSED) {
+  const struct thread* a = list_entry(a_, struct thread, elem);
+  const struct thread* b = list_entry(b_, struct thread, elem);
+  return a->priority < b->priority;
+}
+
+/* Sets the current thread's nice value to NICE, recomputes its
+   priority, and yields if it no longer has the highest
+   priority. */
+void thread_set_nice(int nice) {
+  struct thread* cur = thread_current();
+  enum intr_level old_level;
+
+  ASSERT(NICE_MIN <= nice && nice <= NICE_MAX);
+
+  old_level = intr_disable();
+  cur->nice = nice;
+  if (thread_mlfqs)
+    mlfqs_update_priority(cur, NULL);
+  intr_set_level(old_level);
+  thread_preempt();
+}
+
+/* Returns the current thread's nice value. */
+int thread_get_nice(void) { return thread_current()->nice; }
+
 /* Returns 100 times the system load average. */
 int thread_get_load_avg(void) {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable();
+  int load = fix_round(fix_scale(load_avg, 100));
+  intr_set_level(old_level);
+  return load;
 }
 
 /* Returns 100 times the current thread's recent_cpu value. */
 int thread_get_recent_cpu(void) {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable();
+  int recent = fix_round(fix_scale(thread_current()->recent_cpu, 100));
+  intr_set_level(old_level);
+  return recent;
 }
 
 /* Idle thread.  Executes when no other thread is ready to run.
@@ -332,10 +541,17 @@ static void idle(void* idle_started_ UNUSED) {
   sema_up(idle_started);
 
   for (;;) {
-    /* Let someone else run. */
+    /* Let someone else run.  The scheduler catches up on any
+       timer ticks skipped while we were halted if it switches to
+       another thread; otherwise a tickless idle period carries
+       on. */
     intr_disable();
     thread_block();
 
+    /* Nothing else can run.  In tickless mode, stop the periodic
+       timer interrupt until the next sleeper is due. */
+    timer_idle_enter();
+
     /* Re-enable interrupts and wait for the next one.
          The `sti' instruction disables interrupts until the
          completion of the next instruction, so these two
@@ -377,6 +593,7 @@ static bool is_thread(struct thread* t) { return t != NULL && t->magic == THREAD
 /* Does basic initialization of T as a blocked thread named
    NAME. */
 static void init_thread(struct thread* t, const char* name, int priority) {
+  struct thread* parent = running_thread();
   enum intr_level old_level;
 
   ASSERT(t != NULL);
@@ -387,11 +604,26 @@ static void init_thread(struct thread* t, const char* name, int priority) {
   t->status = THREAD_BLOCKED;
   strlcpy(t->name, name, sizeof t->name);
   t->stack = (uint8_t*)t + PGSIZE;
-  t->priority = priority;
+  t->priority = t->base_priority = priority;
+  t->waiting_lock = NULL;
+  list_init(&t->held_locks);
   t->magic = THREAD_MAGIC;
+
+  /* Threads inherit their creator's nice and recent_cpu.  Under
+     the MLFQS those, not PRIORITY, set the priority.  The initial
+     thread starts at 0 for both. */
+  if (is_thread(parent) && parent != t) {
+    t->nice = parent->nice;
+    t->recent_cpu = parent->recent_cpu;
+  } else {
+    t->nice = 0;
+    t->recent_cpu = fix_int(0);
+  }
   t->cwd = NULL;
 
   old_level = intr_disable();
+  if (thread_mlfqs)
+    mlfqs_update_priority(t, NULL);
   list_push_back(&all_list, &t->allelem);
   intr_set_level(old_level);
 }
@@ -407,16 +639,51 @@ static void* alloc_frame(struct thread* t, size_t size) {
   return t->stack;
 }
 
-/* Chooses and returns the next thread to be scheduled.  Should
-   return a thread from the run queue, unless the run queue is
-   empty.  (If the running thread can continue running, then it
-   will be in the run queue.)  If the run queue is empty, return
-   idle_thread. */
+/* Adds T to the back of the ready queue for its priority.
+   Interrupts must be off. */
+static void ready_push(struct thread* t) {
+  list_push_back(&ready_queues[t->priority], &t->elem);
+  ready_mask |= (uint64_t)1 << t->priority;
+  ready_cnt++;
+}
+
+/* Removes ready thread T from its ready queue.  Interrupts must
+   be off. */
+static void ready_remove(struct thread* t) {
+  list_remove(&t->elem);
+  ready_cnt--;
+  if (list_empty(&ready_queues[t->priority]))
+    ready_mask &= ~((uint64_t)1 << t->priority);
+}
+
+/* Returns the highest priority with a ready thread, or -1 if no
+   thread is ready.  Interrupts must be off.  The mask is split
+   in halves because the kernel is not linked with libgcc, which
+   has the 64-bit bit scans. */
+static int ready_max_priority(void) {
+  uint32_t high = ready_mask >> 32, low = ready_mask;
+
+  if (high != 0)
+    return 63 - __builtin_clz(high);
+  else if (low != 0)
+    return 31 - __builtin_clz(low);
+  else
+    return -1;
+}
+
+/* Chooses and returns the next thread to be scheduled: the first
+   thread in the highest-priority nonempty ready queue.  (If the
+   running thread can continue running, then it will be in a
+   ready queue.)  If no thread is ready, returns idle_thread. */
 static struct thread* next_thread_to_run(void) {
-  if (list_empty(&ready_list))
+  int priority = ready_max_priority();
+  struct thread* t;
+
+  if (priority < 0)
     return idle_thread;
-  else
-    return list_entry(list_pop_front(&ready_list), struct thread, elem);
+  t = list_entry(list_front(&ready_queues[priority]), struct thread, elem);
+  ready_remove(t);
+  return t;
 }
 
 /* Completes a thread switch by activating the new thread's page
@@ -474,8 +741,16 @@ static void schedule(void) {
   ASSERT(cur->status != THREAD_RUNNING);
   ASSERT(is_thread(next));
 
-  if (cur != next)
+  /* An interrupt that ended a tickless idle period woke NEXT:
+     catch up on the skipped ticks and restore the periodic timer
+     before NEXT runs. */
+  if (cur == idle_thread && next != cur)
+    timer_idle_exit();
+
+  if (cur != next) {
+    TRACE(TRACE_SCHEDULE, cur->tid, next->tid, cur->status);
     prev = switch_threads(cur, next);
+  }
   thread_schedule_tail(prev);
 }
 
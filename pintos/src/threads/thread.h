@@ -25,6 +25,10 @@ typedef int tid_t;
 #define PRI_DEFAULT 31 /* Default priority. */
 #define PRI_MAX 63     /* Highest priority. */
 
+/* Thread niceness, for the MLFQS. */
+#define NICE_MIN -20 /* Nicest to other threads. */
+#define NICE_MAX 20  /* Least nice. */
+
 /* A kernel thread or user process.
    Each thread structure is stored in its own 4 kB page.  The
    thread structure itself sits at the very bottom of the page
@@ -71,10 +75,11 @@ typedef int tid_t;
    value, triggering the assertion. */
 /* The `elem' member has a dual purpose.  It can be an element in
    the run queue (thread.c), or it can be an element in a
-   semaphore wait list (synch.c).  It can be used these two ways
-   only because they are mutually exclusive: only a thread in the
-   ready state is on the run queue, whereas only a thread in the
-   blocked state is on a semaphore wait list. */
+   semaphore wait list (synch.c) or the sleep list (timer.c).  It
+   can be used these ways only because they are mutually
+   exclusive: only a thread in the ready state is on the run
+   queue, whereas only a thread in the blocked state is on a
+   semaphore wait list or the sleep list. */
 struct p_wait_info {
   tid_t child;
   bool parent_is_waiting;
@@ -105,15 +110,30 @@ struct thread {
   char name[16];             /* Name (for debugging purposes). */
   int fd_count;
   uint8_t* stack;           /* Saved stack pointer. */
-  int priority;             /* Priority. */
+  int priority;             /* Effective priority, with donations. */
+  int base_priority;        /* Priority set by the thread itself. */
+  int nice;                 /* Niceness, for the MLFQS. */
+  fixed_point_t recent_cpu; /* Recent CPU time used, for the MLFQS. */
   struct list_elem allelem; /* List element for all threads list. */
   struct dir* cwd;
-  /* Shared between thread.c and synch.c. */
+  /* Shared between thread.c, synch.c and devices/timer.c. */
   struct list_elem elem; /* List element. */
 
+  /* Owned by synch.c. */
+  struct lock* waiting_lock; /* Lock being waited for, or NULL. */
+  struct list held_locks;    /* Locks held, which may carry donations. */
+
+  /* Owned by devices/timer.c. */
+  int64_t wake_tick; /* Tick to wake at, while in timer_sleep(). */
+
 #ifdef USERPROG
   /* Owned by userprog/process.c. */
   uint32_t* pagedir; /* Page directory. */
+
+  /* Owned by userprog/syscall.c. */
+  struct sysstat* syscall_stats; /* SYSCALL_CNT per-call statistics, or NULL. */
+  bool in_syscall;               /* Inside syscall_handler()? */
+  int syscall_nr;                /* System call number, while IN_SYSCALL. */
 #endif
 
   /* Owned by thread.c. */
@@ -150,6 +170,10 @@ void thread_foreach(thread_action_func*, void*);
 
 int thread_get_priority(void);
 void thread_set_priority(int);
+void thread_update_priority(struct thread*, int priority);
+void thread_refresh_priority(struct thread*);
+void thread_preempt(void);
+bool thread_priority_less(const struct list_elem*, const struct list_elem*, void* aux);
 
 int thread_get_nice(void);
 void thread_set_nice(int);
@@ -0,0 +1,174 @@
+#include "threads/trace.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/tsc.h"
+#include "threads/vaddr.h"
+#ifdef FILESYS
+#include "devices/block.h"
+#endif
+
+/* Kernel event tracing.
+
+   trace_record() appends a fixed-size record to a ring of
+   TRACE_RECORDS records.  A slot is claimed with a single atomic
+   increment of the head index, so recording takes no lock and
+   works with interrupts on or off, in interrupt handlers, and in
+   the middle of a thread switch.  Once the ring is full, new
+   records overwrite the oldest ones.
+
+   At shutdown, trace_dump() stops tracing and writes the ring out,
+   oldest record first, for utils/trace2json to turn into a trace
+   that Chrome's trace viewer or Perfetto can show. */
+
+enum trace_dump trace_dump_to;
+bool trace_on;
+
+static struct trace_record* ring; /* TRACE_RECORDS records. */
+static uint32_t head;              /* Number of records ever claimed. */
+static uint64_t start_tsc;         /* Time-stamp counter at trace_init(). */
+static int64_t start_ticks;        /* Timer ticks at trace_init(). */
+
+/* Allocates the ring and starts tracing, if a dump was asked for. */
+void trace_init(void) {
+  struct thread* cur = thread_current();
+
+  if (trace_dump_to == TRACE_OFF)
+    return;
+  ring = palloc_get_multiple(PAL_ASSERT | PAL_ZERO,
+                             DIV_ROUND_UP(TRACE_RECORDS * sizeof *ring, PGSIZE));
+  start_tsc = rdtsc();
+  start_ticks = timer_ticks();
+  trace_on = true;
+  trace_thread_name(cur->tid, cur->name);
+}
+
+/* Returns the running thread.  Unlike thread_current(), works in
+   the middle of a thread switch, when the running thread's status
+   is no longer THREAD_RUNNING. */
+static struct thread* running(void) {
+  uint32_t* esp;
+
+  asm("mov %%esp, %0" : "=g"(esp));
+  return pg_round_down(esp);
+}
+
+/* Appends a record of EVENT with arguments A0, A1 and A2.  Use
+   the TRACE macro instead, which skips this if tracing is off. */
+void trace_record(enum trace_event event, uint32_t a0, uint32_t a1, uint32_t a2) {
+  uint32_t slot = __atomic_fetch_add(&head, 1, __ATOMIC_RELAXED);
+  struct trace_record* r = &ring[slot & (TRACE_RECORDS - 1)];
+
+  r->tsc = rdtsc();
+  r->event = event;
+  r->tid = running()->tid;
+  r->arg[0] = a0;
+  r->arg[1] = a1;
+  r->arg[2] = a2;
+}
+
+/* Records that thread TID is called NAME, of which the trace
+   keeps the first 8 bytes. */
+void trace_thread_name(int tid, const char* name) {
+  uint32_t words[2] = {0, 0};
+
+  memcpy(words, name, strnlen(name, sizeof words));
+  TRACE(TRACE_THREAD_NAME, tid, words[0], words[1]);
+}
+
+/* Prints H and then the records before END, one per line in hex
+   as they lie in memory. */
+static void dump_console(const struct trace_header* h, uint32_t end) {
+  static const char digits[] = "0123456789abcdef";
+
+  printf("Trace: %" PRIu32 " records, %" PRIu32 " lost, %" PRIu64 " Hz\n", h->record_cnt,
+         h->lost_cnt, h->tsc_hz);
+  for (uint32_t i = end - h->record_cnt; i != end; i++) {
+    const uint8_t* r = (const uint8_t*)&ring[i & (TRACE_RECORDS - 1)];
+    char hex[sizeof *ring * 2 + 1];
+
+    for (size_t j = 0; j < sizeof *ring; j++) {
+      hex[j * 2] = digits[r[j] >> 4];
+      hex[j * 2 + 1] = digits[r[j] & 0xf];
+    }
+    hex[sizeof hex - 1] = '\0';
+    printf("trace %s\n", hex);
+  }
+}
+
+#ifdef FILESYS
+/* Writes H to the first sector of the scratch device and the
+   records before END, packed, to the sectors after it, keeping
+   the newest records that fit.  Returns false if there is no
+   scratch device, or if it cannot be used because interrupts
+   are off. */
+static bool dump_scratch(struct trace_header* h, uint32_t end) {
+  struct block* scratch = block_get_role(BLOCK_SCRATCH);
+  uint8_t sector[BLOCK_SECTOR_SIZE];
+  block_sector_t sector_idx = 0;
+  size_t fit, ofs = 0;
+
+  if (scratch == NULL || block_size(scratch) < 2 || intr_get_level() == INTR_OFF)
+    return false;
+  fit = (block_size(scratch) - 1) * BLOCK_SECTOR_SIZE / sizeof *ring;
+  if (h->record_cnt > fit) {
+    h->lost_cnt += h->record_cnt - fit;
+    h->record_cnt = fit;
+  }
+
+  memset(sector, 0, sizeof sector);
+  memcpy(sector, h, sizeof *h);
+  block_write(scratch, sector_idx++, sector);
+  for (uint32_t i = end - h->record_cnt; i != end; i++) {
+    const uint8_t* r = (const uint8_t*)&ring[i & (TRACE_RECORDS - 1)];
+    for (size_t j = 0; j < sizeof *ring; j++) {
+      sector[ofs++] = r[j];
+      if (ofs == BLOCK_SECTOR_SIZE) {
+        block_write(scratch, sector_idx++, sector);
+        ofs = 0;
+      }
+    }
+  }
+  if (ofs > 0) {
+    memset(sector + ofs, 0, BLOCK_SECTOR_SIZE - ofs);
+    block_write(scratch, sector_idx, sector);
+  }
+  printf("Trace: %" PRIu32 " records written to %s, %" PRIu32 " lost\n", h->record_cnt,
+         block_name(scratch), h->lost_cnt);
+  return true;
+}
+#endif
+
+/* Stops tracing and writes the trace where trace_dump_to says.
+   A scratch dump falls back to the console if there is no
+   scratch device. */
+void trace_dump(void) {
+  struct trace_header h;
+  int64_t ticks;
+  uint32_t end;
+
+  if (!trace_on)
+    return;
+  trace_on = false;
+  end = head;
+
+  memcpy(h.magic, TRACE_MAGIC, sizeof h.magic);
+  h.version = TRACE_VERSION;
+  h.record_size = sizeof *ring;
+  h.record_cnt = end < TRACE_RECORDS ? end : TRACE_RECORDS;
+  h.lost_cnt = end - h.record_cnt;
+  ticks = timer_elapsed(start_ticks);
+  h.tsc_hz = ticks > 0 ? (rdtsc() - start_tsc) * TIMER_FREQ / ticks : 0;
+
+#ifdef FILESYS
+  if (trace_dump_to == TRACE_SCRATCH && dump_scratch(&h, end))
+    return;
+#endif
+  dump_console(&h, end);
+}
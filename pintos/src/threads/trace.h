@@ -0,0 +1,73 @@
+#ifndef THREADS_TRACE_H
+#define THREADS_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Trace events, with the meaning of their arguments. */
+enum trace_event {
+  TRACE_THREAD_NAME,   /* Thread created: tid, name bytes 0-3, 4-7. */
+  TRACE_SCHEDULE,      /* Thread switch: old tid, new tid, old status. */
+  TRACE_BLOCK,         /* Running thread blocks. */
+  TRACE_UNBLOCK,       /* Thread made ready: its tid. */
+  TRACE_SYSCALL_ENTER, /* System call: number. */
+  TRACE_SYSCALL_EXIT,  /* System call returns: number, return value. */
+  TRACE_CACHE_HIT,     /* Buffer cache hit: sector. */
+  TRACE_CACHE_MISS,    /* Buffer cache miss: sector. */
+  TRACE_IO_START,      /* Block transfer: first sector, count, 1 if write. */
+  TRACE_IO_DONE,       /* Block transfer done: same as TRACE_IO_START. */
+  TRACE_PAGE_FAULT,    /* Page fault: address, eip, error code. */
+};
+
+/* A trace record.  Dumps are arrays of these, little-endian, in
+   the order they were recorded; utils/trace2json reads them. */
+struct trace_record {
+  uint64_t tsc;    /* Time-stamp counter when recorded. */
+  uint16_t event;  /* A TRACE_* event. */
+  uint16_t tid;    /* Running thread's tid, low 16 bits. */
+  uint32_t arg[3]; /* Event arguments. */
+};
+
+/* Header of a trace dump written to the scratch device, in its
+   first sector.  The records follow from the second sector on. */
+#define TRACE_MAGIC "PINTRACE"
+#define TRACE_VERSION 1
+struct trace_header {
+  char magic[8];        /* TRACE_MAGIC, not null terminated. */
+  uint32_t version;     /* TRACE_VERSION. */
+  uint32_t record_size; /* sizeof (struct trace_record). */
+  uint32_t record_cnt;  /* Number of records in the dump. */
+  uint32_t lost_cnt;    /* Older records overwritten or left out. */
+  uint64_t tsc_hz;      /* Time-stamp counter ticks per second. */
+};
+
+/* Number of records kept, a power of 2.  The oldest records are
+   overwritten once it fills up. */
+#define TRACE_RECORDS 8192
+
+/* Where the trace goes at shutdown, set by the "-trace" kernel
+   command-line option. */
+enum trace_dump {
+  TRACE_OFF,     /* No tracing. */
+  TRACE_CONSOLE, /* Print records in hex on the console. */
+  TRACE_SCRATCH  /* Write records to the scratch device. */
+};
+extern enum trace_dump trace_dump_to;
+
+/* True while records are being taken. */
+extern bool trace_on;
+
+/* Records EVENT with arguments A0, A1 and A2, if tracing is on.
+   Cheap enough to leave in hot paths when it is off. */
+#define TRACE(EVENT, A0, A1, A2)                                                                   \
+  do {                                                                                             \
+    if (trace_on)                                                                                  \
+      trace_record(EVENT, (uint32_t)(A0), (uint32_t)(A1), (uint32_t)(A2));                         \
+  } while (0)
+
+void trace_init(void);
+void trace_record(enum trace_event, uint32_t, uint32_t, uint32_t);
+void trace_thread_name(int tid, const char* name);
+void trace_dump(void);
+
+#endif /* threads/trace.h */
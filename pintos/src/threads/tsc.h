@@ -0,0 +1,14 @@
+#ifndef THREADS_TSC_H
+#define THREADS_TSC_H
+
+#include <stdint.h>
+
+/* Returns the processor's time-stamp counter, the number of
+   clock cycles since reset.  See [IA32-v2b] "RDTSC". */
+static inline uint64_t rdtsc(void) {
+  uint64_t tsc;
+  asm volatile("rdtsc" : "=A"(tsc));
+  return tsc;
+}
+
+#endif /* threads/tsc.h */
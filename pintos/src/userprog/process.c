@@ -7,6 +7,7 @@
 #include <string.h>
 #include "userprog/gdt.h"
 #include "userprog/pagedir.h"
+#include "userprog/syscall.h"
 #include "userprog/tss.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
@@ -226,6 +227,8 @@ void process_exit(void) {
   struct thread* cur = thread_current();
   uint32_t* pd;
 
+  syscall_process_exit();
+
   if (cur->self != NULL) {
     file_allow_write(cur->self);
     file_close(cur->self);
@@ -251,6 +254,7 @@ void process_exit(void) {
         lock_acquire(&(pwi->access));
         pwi->ref_count--;
         if (pwi->ref_count == 0) {
+          lock_release(&(pwi->access));
           free(pwi);
         } else {
           lock_release(&(pwi->access));
@@ -261,6 +265,7 @@ void process_exit(void) {
       lock_acquire(&(parent->access));
       parent->ref_count--;
       if (parent->ref_count == 0) {
+        lock_release(&(parent->access));
         free(parent);
       } else {
         parent->exit_status = -1;
@@ -5,6 +5,8 @@
 #include <string.h>
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
+#include "threads/tsc.h"
 #include "threads/vaddr.h"
 #include "process.h"
 #include "pagedir.h"
@@ -19,9 +21,43 @@
 
 static struct lock filesys_lock;
 static struct lock p_exec_lock;
+
+bool syscall_stats_per_process;
+
+/* Statistics for each system call number, over all processes.
+   Updated with interrupts off. */
+static struct sysstat system_stats[SYSCALL_CNT];
+
+/* System call names, for printing statistics. */
+static const char* syscall_names[SYSCALL_CNT] = {
+    [SYS_HALT] = "halt",
+    [SYS_EXIT] = "exit",
+    [SYS_EXEC] = "exec",
+    [SYS_WAIT] = "wait",
+    [SYS_CREATE] = "create",
+    [SYS_REMOVE] = "remove",
+    [SYS_OPEN] = "open",
+    [SYS_FILESIZE] = "filesize",
+    [SYS_READ] = "read",
+    [SYS_WRITE] = "write",
+    [SYS_SEEK] = "seek",
+    [SYS_TELL] = "tell",
+    [SYS_CLOSE] = "close",
+    [SYS_PRACTICE] = "practice",
+    [SYS_MMAP] = "mmap",
+    [SYS_MUNMAP] = "munmap",
+    [SYS_CHDIR] = "chdir",
+    [SYS_MKDIR] = "mkdir",
+    [SYS_READDIR] = "readdir",
+    [SYS_ISDIR] = "isdir",
+    [SYS_INUMBER] = "inumber",
+    [SYS_LOCKSTAT] = "lockstat",
+    [SYS_SYSSTAT] = "sysstat",
+};
+
 static void syscall_handler(struct intr_frame*);
 void syscall_init(void);
-bool correct_args(uint32_t*);
+bool correct_args(uint32_t, uint32_t*);
 void system_exit(int);
 bool byte_checker(void*, struct thread*);
 bool str_checker(void*, struct thread*);
@@ -35,9 +71,179 @@ bool sys_create(const char*, off_t);
 void syscall_init(void) {
   intr_register_int(0x30, 3, INTR_ON, syscall_handler, "syscall");
   lock_init(&filesys_lock);
+  lock_set_name(&filesys_lock, "filesys_lock");
   lock_init(&p_exec_lock);
 }
 
+/* Returns how many lockstat records a SYS_LOCKSTAT call asking
+   for MAX of them will write. */
+static size_t lockstat_cnt(int max) {
+  return max <= 0 ? 0 : max < LOCK_STATS_MAX ? (size_t)max : LOCK_STATS_MAX;
+}
+
+/* Returns the latency bucket for a call that took CYCLES cycles:
+   the base-2 logarithm of CYCLES, rounded down and capped at the
+   last bucket. */
+static int latency_bucket(uint64_t cycles) {
+  uint32_t high = cycles >> 32, low = cycles;
+  int bucket;
+
+  // split in halves, there is no 64-bit count-leading-zeros without libgcc
+  if (high != 0)
+    bucket = 63 - __builtin_clz(high);
+  else
+    bucket = low != 0 ? 31 - __builtin_clz(low) : 0;
+  return bucket < SYSSTAT_BUCKETS ? bucket : SYSSTAT_BUCKETS - 1;
+}
+
+/* Returns true if system call NR failed, given that it returned
+   RET.  Calls that cannot fail, or that report failure by
+   killing the process, return false here, as does wait(), whose
+   -1 is also the exit status of a child that was killed. */
+static bool syscall_failed(uint32_t nr, int ret) {
+  switch (nr) {
+    case SYS_EXEC:
+    case SYS_OPEN:
+    case SYS_FILESIZE:
+    case SYS_READ:
+    case SYS_WRITE:
+    case SYS_MMAP:
+    case SYS_INUMBER:
+      return ret == -1;
+    case SYS_CREATE:
+    case SYS_REMOVE:
+    case SYS_CHDIR:
+    case SYS_MKDIR:
+    case SYS_READDIR:
+    case SYS_SYSSTAT:
+      return ret == 0;
+  }
+  return false;
+}
+
+/* Counts a call to system call NR in the system-wide statistics
+   and the current process's, and returns the time-stamp counter
+   at its start. */
+static uint64_t syscall_begin(uint32_t nr) {
+  struct thread* cur = thread_current();
+  enum intr_level old_level;
+
+  if (nr < SYSCALL_CNT) {
+    if (cur->syscall_stats == NULL)
+      cur->syscall_stats = calloc(SYSCALL_CNT, sizeof *cur->syscall_stats);
+    if (cur->syscall_stats != NULL)
+      cur->syscall_stats[nr].calls++;
+    old_level = intr_disable();
+    system_stats[nr].calls++;
+    intr_set_level(old_level);
+    cur->in_syscall = true;
+    cur->syscall_nr = nr;
+  }
+  return rdtsc();
+}
+
+/* Records the latency of a call to system call NR that started at
+   time-stamp counter START and returned RET. */
+static void syscall_end(uint32_t nr, int ret, uint64_t start) {
+  struct thread* cur = thread_current();
+  int bucket = latency_bucket(rdtsc() - start);
+  bool failed = syscall_failed(nr, ret);
+  enum intr_level old_level;
+
+  if (nr >= SYSCALL_CNT)
+    return;
+  cur->in_syscall = false;
+  if (cur->syscall_stats != NULL) {
+    cur->syscall_stats[nr].hist[bucket]++;
+    cur->syscall_stats[nr].errors += failed;
+  }
+  old_level = intr_disable();
+  system_stats[nr].hist[bucket]++;
+  system_stats[nr].errors += failed;
+  intr_set_level(old_level);
+}
+
+/* Prints a line for every system call made in STATS, which has
+   SYSCALL_CNT entries. */
+static void print_sysstats(const struct sysstat* stats) {
+  for (int nr = 0; nr < SYSCALL_CNT; nr++) {
+    const struct sysstat* s = &stats[nr];
+    if (s->calls == 0)
+      continue;
+    printf("  %-9s %8u %8u", syscall_names[nr], s->calls, s->errors);
+    for (int b = 0; b < SYSSTAT_BUCKETS; b++)
+      if (s->hist[b] != 0)
+        printf(" %d:%u", b, s->hist[b]);
+    printf("\n");
+  }
+}
+
+/* Prints system call statistics over all processes. */
+void syscall_print_stats(void) {
+  printf("Syscalls: name, calls, errors, log2(cycles):calls\n");
+  print_sysstats(system_stats);
+}
+
+/* Called by process_exit().  If the process is being killed in
+   the middle of a system call, counts that call as failed.
+   Prints the process's statistics if -syscallstats was given,
+   then frees them. */
+void syscall_process_exit(void) {
+  struct thread* cur = thread_current();
+
+  if (cur->in_syscall && cur->syscall_nr != SYS_EXIT) {
+    enum intr_level old_level = intr_disable();
+    system_stats[cur->syscall_nr].errors++;
+    intr_set_level(old_level);
+    if (cur->syscall_stats != NULL)
+      cur->syscall_stats[cur->syscall_nr].errors++;
+  }
+  if (syscall_stats_per_process && cur->syscall_stats != NULL) {
+    printf("Syscalls of %s: name, calls, errors, log2(cycles):calls\n", cur->name);
+    print_sysstats(cur->syscall_stats);
+  }
+  free(cur->syscall_stats);
+  cur->syscall_stats = NULL;
+}
+
+/* Copies the statistics for system call NR, over all processes if
+   SYSTEM is true and for the current process otherwise, into
+   *STATS.  Returns false if NR is not a system call number. */
+static bool sys_sysstat(int nr, bool system, struct sysstat* stats) {
+  struct thread* cur = thread_current();
+  enum intr_level old_level;
+
+  if (nr < 0 || nr >= SYSCALL_CNT)
+    return false;
+  if (system) {
+    old_level = intr_disable();
+    *stats = system_stats[nr];
+    intr_set_level(old_level);
+  } else if (cur->syscall_stats != NULL)
+    *stats = cur->syscall_stats[nr];
+  else
+    memset(stats, 0, sizeof *stats);
+  return true;
+}
+
+/* Copies statistics for up to MAX named kernel locks into STATS
+   and returns how many were copied. */
+static int sys_lockstat(struct lockstat* stats, int max) {
+  struct lock_stats s;
+  size_t i;
+
+  for (i = 0; i < lockstat_cnt(max) && lock_get_stats(i, &s); i++) {
+    strlcpy(stats[i].name, s.name, sizeof stats[i].name);
+    stats[i].acquired = s.acquired;
+    stats[i].contended = s.contended;
+    stats[i].wait_ticks = s.wait_ticks;
+    stats[i].max_wait = s.max_wait;
+    stats[i].hold_ticks = s.hold_ticks;
+    stats[i].max_hold = s.max_hold;
+  }
+  return i;
+}
+
 bool byte_checker(void* mem, struct thread* ct) {
   char* byte_check = (char*)mem;
   return is_user_vaddr(&byte_check[0]) && is_user_vaddr(&byte_check[1]) &&
@@ -72,11 +278,9 @@ bool pointer_check(void* val, struct thread* ct) {
 }
 
 /* argument checker */
-bool correct_args(uint32_t* args) {
+bool correct_args(uint32_t nr, uint32_t* args) {
   struct thread* ct = thread_current();
-  if (!byte_checker(&args[0], ct))
-    return false;
-  switch (args[0]) {
+  switch (nr) {
     case SYS_EXIT:
     case SYS_PRACTICE:
     case SYS_WAIT:
@@ -112,6 +316,28 @@ bool correct_args(uint32_t* args) {
       return pointer_check(&args[1], ct) && val_check(&args[2], ct) && str_checker(&args[1], ct);
     case SYS_SEEK:
       return val_check(&args[1], ct) && val_check(&args[2], ct);
+    case SYS_LOCKSTAT: {
+      if (!val_check(&args[1], ct) || !val_check(&args[2], ct))
+        return false;
+      /* Checks that buffer args[1] can hold the records that will be written */
+      for (size_t i = 0; i < lockstat_cnt(args[2]) * sizeof(struct lockstat); i++) {
+        if (!is_user_vaddr(&((char*)args[1])[i]) ||
+            !pagedir_get_page(ct->pagedir, &((char*)args[1])[i]))
+          return false;
+      }
+      return true;
+    }
+    case SYS_SYSSTAT: {
+      if (!val_check(&args[1], ct) || !val_check(&args[2], ct) || !pointer_check(&args[3], ct))
+        return false;
+      /* Checks that buffer args[3] can hold a struct sysstat */
+      for (size_t i = 0; i < sizeof(struct sysstat); i++) {
+        if (!is_user_vaddr(&((char*)args[3])[i]) ||
+            !pagedir_get_page(ct->pagedir, &((char*)args[3])[i]))
+          return false;
+      }
+      return true;
+    }
     case SYS_READ:
     case SYS_WRITE: {
       bool ret_val =
@@ -144,6 +370,7 @@ void system_exit(int err) {
     lock_acquire(&(pwi->access));
     pwi->ref_count--;
     if (pwi->ref_count == 0) {
+      lock_release(&(pwi->access));
       free(pwi);
     } else {
       lock_release(&(pwi->access));
@@ -154,6 +381,7 @@ void system_exit(int err) {
     lock_acquire(&(parent->access));
     parent->ref_count--;
     if (parent->ref_count == 0) {
+      lock_release(&(parent->access));
       free(parent);
     } else {
       parent->exit_status = err;
@@ -276,12 +504,22 @@ bool sys_create(const char* input_path, off_t initial_size) {
 
 static void syscall_handler(struct intr_frame* f UNUSED) {
   uint32_t* args = ((uint32_t*)f->esp);
-  if (args == NULL || !is_user_vaddr((void*)args) ||
-      pagedir_get_page(thread_current()->pagedir, args) == NULL || !correct_args(args)) {
+  uint32_t nr;
+  uint64_t start;
+  if (args == NULL || !byte_checker(args, thread_current()))
     system_exit(-1);
-  }
 
-  switch (args[0]) {
+  /* Read the call number once, so that the statistics and trace
+     see the call that was dispatched even if the call itself
+     writes to the user stack (read() into its own arguments).
+     The call is counted before its arguments are checked, so that
+     a process killed for bad arguments counts it as failed. */
+  nr = args[0];
+  TRACE(TRACE_SYSCALL_ENTER, nr, 0, 0);
+  start = syscall_begin(nr);
+  if (!correct_args(nr, args))
+    system_exit(-1);
+  switch (nr) {
     struct file_info* fi;
     struct inode* inode;
     struct thread* curr_thread;
@@ -298,6 +536,12 @@ static void syscall_handler(struct intr_frame* f UNUSED) {
     case SYS_PRACTICE:
       f->eax = args[1] + 1;
       break;
+    case SYS_LOCKSTAT:
+      f->eax = sys_lockstat((struct lockstat*)args[1], args[2]);
+      break;
+    case SYS_SYSSTAT:
+      f->eax = sys_sysstat(args[1], args[2], (struct sysstat*)args[3]);
+      break;
     case SYS_HALT:
       buffer_flush(); // Flush the Buffer
       shutdown_power_off();
@@ -481,4 +725,6 @@ static void syscall_handler(struct intr_frame* f UNUSED) {
       // lock_release(&filesys_lock);
       break;
   }
+  TRACE(TRACE_SYSCALL_EXIT, nr, f->eax, 0);
+  syscall_end(nr, f->eax, start);
 }
@@ -1,6 +1,18 @@
 #ifndef USERPROG_SYSCALL_H
 #define USERPROG_SYSCALL_H
 
+#include <stdbool.h>
+#include <syscall-nr.h>
+
+/* Number of system call numbers. */
+#define SYSCALL_CNT (SYS_SYSSTAT + 1)
+
+/* Print each process's system call statistics when it exits?
+   Set by the "-syscallstats" kernel command-line option. */
+extern bool syscall_stats_per_process;
+
 void syscall_init(void);
+void syscall_process_exit(void);
+void syscall_print_stats(void);
 
 #endif /* userprog/syscall.h */